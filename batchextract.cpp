@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QRegularExpression>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
+#include "batchextract.h"
+#include "exportengine.h"
+#include "fileidindex.h"
+#include "previewloader.h"
+#include "MemoryStream.h"
+#include "deadfiles.h"
+#include "debug.h"
+
+#define PROGRESS_INTERVAL_MS    250
+
+static void StdErrPrint(const char *str)
+{
+    fprintf(stderr, "%s", str);
+}
+
+static QRegularExpression GlobToRegExp(const QString &glob)
+{
+    QString re = QRegularExpression::escape(glob);
+
+    re.replace("\\*", ".*");
+    re.replace("\\?", ".");
+
+    return QRegularExpression("^" + re + "$", QRegularExpression::CaseInsensitiveOption);
+}
+
+static bool ParseHex(const QString &str, uint32_t *ret)
+{
+    QString s = str.trimmed();
+
+    if (s.startsWith("0x", Qt::CaseInsensitive))
+        s = s.mid(2);
+
+    bool ok;
+    *ret = s.toUInt(&ok, 16);
+
+    return (ok && s.length() > 0);
+}
+
+// Lookups of every file id of the rdb, and as many random ones (mostly misses), through
+// FileIdIndex and through RdbFile::FindFileByID, which is linear, so it only gets a sample.
+static int BenchFileIds(RdbFile &rdb)
+{
+    const size_t num_files = rdb.GetNumFiles();
+    const size_t linear_lookups = std::min<size_t>(num_files * 2, 2000);
+    std::vector<uint32_t> ids;
+    uint32_t seed = 0x12345678;
+
+    ids.reserve(num_files * 2);
+
+    for (size_t i = 0; i < num_files; i++)
+        ids.push_back(rdb.GetEntry(i).file_id);
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        ids.push_back(seed);
+    }
+
+    // Interleave hits and misses
+    for (size_t i = ids.size(); i > 1; i--)
+    {
+        seed = seed * 1664525 + 1013904223;
+        std::swap(ids[i-1], ids[seed % i]);
+    }
+
+    QElapsedTimer timer;
+    FileIdIndex index;
+
+    timer.start();
+    index.Build(&rdb);
+    double build_ms = (double)timer.nsecsElapsed() / 1000000.0;
+
+    // Enough rounds to take a measurable time
+    const int rounds = 20;
+    size_t checksum = 0;
+
+    timer.start();
+    for (int r = 0; r < rounds; r++)
+    {
+        for (uint32_t id : ids)
+            checksum += index.Find(id);
+    }
+    double index_ns = (ids.size() > 0) ? (double)timer.nsecsElapsed() / (double)(ids.size() * rounds) : 0.0;
+
+    size_t mismatches = 0;
+    std::vector<size_t> linear_results(linear_lookups);
+
+    timer.start();
+    for (size_t i = 0; i < linear_lookups; i++)
+        linear_results[i] = rdb.FindFileByID(ids[i]);
+    double linear_ns = (linear_lookups > 0) ? (double)timer.nsecsElapsed() / (double)linear_lookups : 0.0;
+
+    for (size_t i = 0; i < linear_lookups; i++)
+    {
+        if (linear_results[i] != index.Find(ids[i]))
+            mismatches++;
+    }
+
+    printf("{\"event\":\"bench_ids\",\"files\":%llu,\"lookups\":%llu,\"build_ms\":%.3f,\"index_ns\":%.1f,\"find_file_by_id_ns\":%.1f,\"mismatches\":%llu,\"checksum\":%llu}\n",
+           (unsigned long long)num_files, (unsigned long long)ids.size(), build_ms, index_ns, linear_ns,
+           (unsigned long long)mismatches, (unsigned long long)checksum);
+    fflush(stdout);
+
+    return (mismatches == 0) ? 0 : 1;
+}
+
+// Array slices decoded per texture format, at most
+#define BENCH_DECODE_MAX_SLICES 64
+
+struct DecodeBenchFormat
+{
+    size_t files = 0;
+    size_t slices = 0;
+    uint64_t pixels = 0;
+    qint64 single_ns = 0;
+    qint64 banded_ns = 0;
+    size_t mismatches = 0;
+};
+
+// Decodes the array slices of the g1t files of the rdb in one go, and in bands as the preview
+// does, and checks that both give the same bytes. Every slice is banded, whatever its size.
+// The set is fixed for a given rdb: files in rdb order, until a format has its slices.
+static int BenchDecode(RdbFile &rdb)
+{
+    std::map<uint8_t, DecodeBenchFormat> formats;
+    QThreadPool band_pool;
+    QElapsedTimer timer;
+
+    band_pool.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+
+    for (size_t i = 0; i < rdb.GetNumFiles(); i++)
+    {
+        if (!rdb.MatchesType(i, 0xafbec60c)) // g1t
+            continue;
+
+        MemoryStream out;
+        G1tFile g1t;
+        std::vector<uint8_t *> slices;
+
+        if (!rdb.ExtractFile(i, &out, true, false) || !g1t.Load(out.GetMemory(false), out.GetSize()))
+            continue;
+
+        if (g1t.GetNumTextures() != 1 || !g1t.IsArrayTexture(0) || !g1t.DecomposeArrayTextureFast(0, slices, true))
+            continue;
+
+        uint8_t format = g1t[0].format;
+        DecodeBenchFormat &bench = formats[format];
+
+        if (bench.slices >= BENCH_DECODE_MAX_SLICES)
+            continue;
+
+        uint32_t width = g1t[0].width;
+        uint32_t height = g1t[0].height;
+        uint32_t size = g1t.CalculateTextureSize(0, true);
+
+        bench.files++;
+
+        for (uint8_t *slice : slices)
+        {
+            if (bench.slices >= BENCH_DECODE_MAX_SLICES)
+                break;
+
+            G1tFile decoder;
+            bool single_alpha = false, banded_alpha = false;
+
+            timer.start();
+            uint32_t *single = decoder.Decode(slice, size, width, height, format, &single_alpha, false);
+            bench.single_ns += timer.nsecsElapsed();
+
+            timer.start();
+            uint32_t *banded = PreviewWork::DecodeSliceInBands(&band_pool, slice, size, width, height, format, &banded_alpha, 0);
+            bench.banded_ns += timer.nsecsElapsed();
+
+            if ((single == nullptr) != (banded == nullptr))
+                bench.mismatches++;
+            else if (single && (single_alpha != banded_alpha || memcmp(single, banded, (size_t)width*height*sizeof(uint32_t)) != 0))
+                bench.mismatches++;
+
+            delete[] single;
+            delete[] banded;
+
+            bench.slices++;
+            bench.pixels += (uint64_t)width*height;
+        }
+    }
+
+    size_t mismatches = 0;
+
+    for (const auto &it : formats)
+    {
+        const DecodeBenchFormat &bench = it.second;
+        double single_ms = (double)bench.single_ns / 1000000.0;
+        double banded_ms = (double)bench.banded_ns / 1000000.0;
+
+        printf("{\"event\":\"bench_decode\",\"format\":\"0x%02x\",\"files\":%llu,\"slices\":%llu,\"mpixels\":%.2f,\"single_ms\":%.2f,\"banded_ms\":%.2f,\"speedup\":%.2f,\"mismatches\":%llu}\n",
+               it.first, (unsigned long long)bench.files, (unsigned long long)bench.slices, (double)bench.pixels / 1000000.0,
+               single_ms, banded_ms, (banded_ms > 0.0) ? single_ms / banded_ms : 0.0, (unsigned long long)bench.mismatches);
+
+        mismatches += bench.mismatches;
+    }
+
+    fflush(stdout);
+    return (mismatches == 0) ? 0 : 1;
+}
+
+bool IsBatchExtractCommand(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--extract") == 0 || strncmp(argv[i], "--extract=", 10) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+int RunBatchExtract(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+
+    QCommandLineOption extractOption("extract", "Rdb file to extract.", "rdb");
+    QCommandLineOption outOption(QStringList() << "o" << "out", "Output directory.", "dir");
+    QCommandLineOption nameOption(QStringList() << "n" << "name", "Only extract files whose name matches this glob. Can be repeated.", "glob");
+    QCommandLineOption hashOption("hash", "Only extract these file ids (comma separated, hex). Can be repeated.", "list");
+    QCommandLineOption typeOption(QStringList() << "t" << "type", "Only extract files of this extension, or of this type id if it starts by 0x. Can be repeated.", "type");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads", "Number of extraction threads (default: ideal thread count).", "n", "0");
+    QCommandLineOption deadOption("dead-files", "Extract only the dead files of this version.", "version");
+    QCommandLineOption orderOption("order", "Order of the jobs: size (largest first, default) or package (grouped by package file).", "order", "size");
+    QCommandLineOption memoryOption("memory-budget", "Maximum MB of file data being extracted at once (default: no limit).", "mb", "0");
+    QCommandLineOption benchIdsOption("bench-ids", "Don't extract, time the file id lookups of the rdb instead (--out not needed).");
+    QCommandLineOption benchDecodeOption("bench-decode", "Don't extract, time the decoding of g1t array slices in one go and in bands, per format, and compare them (--out not needed).");
+
+    parser.setApplicationDescription("qrdbtool batch extraction");
+    parser.addHelpOption();
+    parser.addOption(extractOption);
+    parser.addOption(outOption);
+    parser.addOption(nameOption);
+    parser.addOption(hashOption);
+    parser.addOption(typeOption);
+    parser.addOption(threadsOption);
+    parser.addOption(deadOption);
+    parser.addOption(orderOption);
+    parser.addOption(memoryOption);
+    parser.addOption(benchIdsOption);
+    parser.addOption(benchDecodeOption);
+    parser.process(app);
+
+    set_debug_level(2);
+    redirect_uprintf(StdErrPrint);
+    redirect_dprintf(StdErrPrint);
+
+    bool bench_ids = parser.isSet(benchIdsOption);
+    bool bench_decode = parser.isSet(benchDecodeOption);
+
+    if (!parser.isSet(extractOption) || (!parser.isSet(outOption) && !bench_ids && !bench_decode))
+    {
+        fprintf(stderr, "Both --extract and --out are required.\n");
+        return 1;
+    }
+
+    std::string rdb_path = Utils::QStringToStdString(parser.value(extractOption));
+    std::string out_dir = Utils::QStringToStdString(parser.value(outOption));
+    QString version = parser.value(deadOption);
+
+    RdbFile rdb(rdb_path);
+
+    if (!rdb.LoadFromFile(rdb_path))
+    {
+        fprintf(stderr, "Failed to load %s\n", rdb_path.c_str());
+        return 1;
+    }
+
+    if (!DeadFilesAnalysis::ApplyVersion(&rdb, version))
+    {
+        fprintf(stderr, "Unknown version %s\n", Utils::QStringToStdString(version).c_str());
+        return 1;
+    }
+
+    if (bench_ids)
+        return BenchFileIds(rdb);
+
+    if (bench_decode)
+        return BenchDecode(rdb);
+
+    // Filters. Different kinds of filters must all match, values of the same kind are alternatives.
+    std::vector<QRegularExpression> names;
+    std::unordered_set<size_t> hashes_idx;
+    std::vector<std::string> exts;
+    std::vector<uint32_t> types;
+
+    for (const QString &glob : parser.values(nameOption))
+        names.push_back(GlobToRegExp(glob));
+
+    FileIdIndex rdb_ids;
+    rdb_ids.Build(&rdb);
+
+    for (const QString &list : parser.values(hashOption))
+    {
+        for (const QString &str : list.split(QRegularExpression("[,\\s]+"), Qt::SkipEmptyParts))
+        {
+            uint32_t hash;
+
+            if (!ParseHex(str, &hash))
+            {
+                fprintf(stderr, "Invalid hash %s\n", Utils::QStringToStdString(str).c_str());
+                return 1;
+            }
+
+            size_t idx = rdb_ids.Find(hash);
+            if (idx == (size_t)-1)
+            {
+                fprintf(stderr, "Warning: hash 0x%08x not found.\n", hash);
+                continue;
+            }
+
+            hashes_idx.insert(idx);
+        }
+    }
+
+    for (const QString &type : parser.values(typeOption))
+    {
+        uint32_t type_id;
+
+        if (type.startsWith("0x", Qt::CaseInsensitive) && ParseHex(type, &type_id))
+            types.push_back(type_id);
+        else
+            exts.push_back(Utils::ToUpperCase(Utils::QStringToStdString(type)));
+    }
+
+    bool filter_hashes = parser.isSet(hashOption);
+    std::vector<size_t> files_idx;
+
+    for (size_t i = 0; i < rdb.GetNumFiles(); i++)
+    {
+        if (filter_hashes && hashes_idx.find(i) == hashes_idx.end())
+            continue;
+
+        std::string name;
+        rdb.GetFileName(i, name);
+
+        if (names.size() > 0)
+        {
+            QString qname = Utils::StdStringToQString(name, false);
+            bool match = false;
+
+            for (const QRegularExpression &re : names)
+            {
+                if (re.match(qname).hasMatch())
+                {
+                    match = true;
+                    break;
+                }
+            }
+
+            if (!match)
+                continue;
+        }
+
+        if (exts.size() > 0 || types.size() > 0)
+        {
+            std::string ext = Utils::ToUpperCase(name.substr(name.rfind('.')+1));
+            bool match = false;
+
+            for (const std::string &e : exts)
+            {
+                if (e == ext)
+                {
+                    match = true;
+                    break;
+                }
+            }
+
+            for (size_t t = 0; t < types.size() && !match; t++)
+            {
+                if (rdb.MatchesType(i, types[t]))
+                    match = true;
+            }
+
+            if (!match)
+                continue;
+        }
+
+        files_idx.push_back(i);
+    }
+
+    Utils::CreatePath(out_dir, true);
+
+    RdbHandlePool rdb_pool;
+    rdb_pool.Setup(rdb_path, version);
+
+    ExportEngine engine(&rdb_pool);
+    QElapsedTimer timer, progress_timer;
+
+    QObject::connect(&engine, &ExportEngine::progress, [&](int jobs_finished, int max_jobs)
+    {
+        if (jobs_finished != max_jobs && progress_timer.elapsed() < PROGRESS_INTERVAL_MS)
+            return;
+
+        progress_timer.restart();
+        printf("{\"event\":\"progress\",\"files\":%d,\"total\":%d,\"bytes\":%llu}\n",
+               jobs_finished, max_jobs, (unsigned long long)engine.GetBytesFinished());
+        fflush(stdout);
+    });
+
+    QObject::connect(&engine, &ExportEngine::finished, [&]()
+    {
+        double seconds = (double)timer.nsecsElapsed() / 1000000000.0;
+        uint64_t bytes = engine.GetBytesFinished();
+
+        if (seconds <= 0.0)
+            seconds = 0.000001;
+
+        printf("{\"event\":\"done\",\"files\":%d,\"bytes\":%llu,\"seconds\":%.3f,\"files_per_sec\":%.1f,\"mb_per_sec\":%.2f}\n",
+               engine.GetNumFinished(), (unsigned long long)bytes, seconds,
+               (double)engine.GetNumFinished() / seconds, (double)bytes / (1024.0*1024.0) / seconds);
+        fflush(stdout);
+
+        app.exit(0);
+    });
+
+    QObject::connect(&engine, &ExportEngine::error, [&]()
+    {
+        printf("{\"event\":\"error\",\"files\":%d,\"total\":%d}\n", engine.GetNumFinished(), engine.GetNumJobs());
+        fflush(stdout);
+
+        app.exit(1);
+    });
+
+    int num_threads = parser.value(threadsOption).toInt();
+    engine.SetMemoryBudget(parser.value(memoryOption).toInt());
+
+    QString order = parser.value(orderOption);
+    if (order == "package")
+    {
+        engine.SetOrder(EXPORT_ORDER_PACKAGE);
+    }
+    else if (order != "size")
+    {
+        fprintf(stderr, "Unknown order %s\n", Utils::QStringToStdString(order).c_str());
+        return 1;
+    }
+
+    printf("{\"event\":\"start\",\"total\":%d,\"threads\":%d}\n", (int)files_idx.size(), (num_threads > 0) ? num_threads : QThread::idealThreadCount());
+    fflush(stdout);
+
+    timer.start();
+    progress_timer.start();
+    engine.Start(&rdb, files_idx, out_dir, num_threads);
+
+    return app.exec();
+}
@@ -0,0 +1,18 @@
+#ifndef BATCHEXTRACT_H
+#define BATCHEXTRACT_H
+
+// Headless extraction, for running without a display:
+//
+// qrdbtool --extract <rdb> --out <dir> [--name <glob>]... [--hash <list>]... [--type <ext|0xtype>]...
+//          [--threads <n>] [--dead-files <version>] [--order size|package] [--memory-budget <mb>]
+// qrdbtool --extract <rdb> --bench-ids
+// qrdbtool --extract <rdb> --bench-decode
+//
+// Progress and the final throughput are printed to stdout as one json object per line.
+// qrdbtool is a GUI executable on Windows, so its stdout is only seen when redirected;
+// qrdbtool-cli (qrdbtool_cli.pro) is the same program built as a console one.
+
+bool IsBatchExtractCommand(int argc, char *argv[]);
+int RunBatchExtract(int argc, char *argv[]);
+
+#endif // BATCHEXTRACT_H
@@ -0,0 +1,182 @@
+#include <QRunnable>
+#include <functional>
+
+#include "deadfiles.h"
+
+// Every analysis holds a whole RdbFile while it loads, and so does every result
+#define DEAD_FILES_MAX_THREADS  2
+#define DEAD_FILES_MAX_RESULTS  4
+
+struct DeadFilesVersion
+{
+    const char *version;
+    const char *bin1;
+    const char *bin1_0;
+    const char *bin2;
+    const char *bin2_0;
+};
+
+static const DeadFilesVersion dead_files_versions[] =
+{
+    { "1.01", ".bin", ".bin_0", nullptr, nullptr },
+    { "1.02", ".bin2", ".bin2_0", nullptr, nullptr },
+    { "1.03", ".bin3", ".bin3_0", nullptr, nullptr },
+    { "1.03b", ".bin4", ".bin4_0", nullptr, nullptr },
+    { "1.04", ".bin6", ".bin6_0", nullptr, nullptr },
+    { "1.04a", ".bin7", ".bin7_0", nullptr, nullptr },
+    { "1.05", ".bin8", ".bin8_0", nullptr, nullptr },
+    { "1.06", ".bin9", ".bin9_0", nullptr, nullptr },
+    { "1.08", ".bin11", ".bin11_0", nullptr, nullptr },
+    { "1.09", ".bin12", ".bin12_0", nullptr, nullptr },
+    { "1.10", ".bin13", ".bin13_0", nullptr, nullptr },
+    { "1.11", ".bin14", ".bin14_0", nullptr, nullptr },
+    { "1.12", ".bin15", ".bin15_0", nullptr, nullptr },
+    { "1.13", ".bin16", ".bin16_0", nullptr, nullptr },
+    { "1.14", ".bin17", ".bin17_0", nullptr, nullptr },
+    { "1.15", ".bin18", ".bin18_0", ".bin19", ".bin19_0" },
+    { "1.16", ".bin20", ".bin20_0", nullptr, nullptr },
+    { "1.17", ".bin21", ".bin21_0", nullptr, nullptr },
+    { "1.18", ".bin22", ".bin22_0", nullptr, nullptr },
+    { "1.19", ".bin23", ".bin23_0", nullptr, nullptr },
+    { "1.20", ".bin24", ".bin24_0", nullptr, nullptr },
+    { "1.21", ".bin25", ".bin25_0", nullptr, nullptr },
+    { "1.22", ".bin27", ".bin27_0", nullptr, nullptr },
+};
+
+class DeadFilesWork : public QRunnable
+{
+public:
+
+    DeadFilesWork(const std::function<void()> &func) : func(func) { }
+    void run() override { func(); }
+
+private:
+
+    std::function<void()> func;
+};
+
+DeadFilesAnalysis::DeadFilesAnalysis(QObject *parent) : QObject(parent)
+{
+    pool.setMaxThreadCount(DEAD_FILES_MAX_THREADS);
+}
+
+DeadFilesAnalysis::~DeadFilesAnalysis()
+{
+    Clear();
+    pool.waitForDone();
+}
+
+const QStringList &DeadFilesAnalysis::GetVersions()
+{
+    static const QStringList versions = []()
+    {
+        QStringList list;
+
+        for (const DeadFilesVersion &dfv : dead_files_versions)
+            list.push_back(dfv.version);
+
+        return list;
+    }();
+
+    return versions;
+}
+
+bool DeadFilesAnalysis::ApplyVersion(RdbFile *rdb, const QString &version)
+{
+    if (version.isEmpty())
+        return true;
+
+    for (const DeadFilesVersion &dfv : dead_files_versions)
+    {
+        if (version != dfv.version)
+            continue;
+
+        if (dfv.bin2)
+            rdb->ReloadAsDeadFiles(dfv.bin1, dfv.bin1_0, dfv.bin2, dfv.bin2_0);
+        else
+            rdb->ReloadAsDeadFiles(dfv.bin1, dfv.bin1_0);
+
+        return true;
+    }
+
+    return false;
+}
+
+void DeadFilesAnalysis::Request(const std::string &rdb_path, const QString &version)
+{
+    if (rdb_path != this->rdb_path)
+    {
+        Clear();
+        this->rdb_path = rdb_path;
+    }
+
+    int gen = generation.loadAcquire();
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (running.contains(version) || results.contains(version))
+            return;
+
+        running.push_back(version);
+    }
+
+    pool.start(new DeadFilesWork([this, rdb_path, version, gen]()
+    {
+        AnalyzeVersion(rdb_path, version, gen);
+    }));
+}
+
+void DeadFilesAnalysis::Clear()
+{
+    // Versions still being analyzed for the previous rdb will be discarded when they finish
+    generation.fetchAndAddOrdered(1);
+    pool.clear();
+    rdb_path.clear();
+
+    QMutexLocker locker(&mutex);
+    running.clear();
+    results.clear();
+    results_order.clear();
+}
+
+bool DeadFilesAnalysis::IsDone(const QString &version) const
+{
+    QMutexLocker locker(&mutex);
+    return results.contains(version);
+}
+
+std::shared_ptr<RdbFile> DeadFilesAnalysis::GetDeadFiles(const QString &version) const
+{
+    QMutexLocker locker(&mutex);
+    return results.value(version);
+}
+
+void DeadFilesAnalysis::AnalyzeVersion(const std::string &rdb_path, const QString &version, int gen)
+{
+    if (generation.loadAcquire() != gen)
+        return;
+
+    std::shared_ptr<RdbFile> rdb = std::make_shared<RdbFile>(rdb_path);
+
+    if (!rdb->LoadFromFile(rdb_path) || !ApplyVersion(rdb.get(), version))
+        rdb.reset();
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (generation.loadAcquire() != gen)
+            return;
+
+        running.removeOne(version);
+        results[version] = rdb;
+        results_order.removeOne(version);
+        results_order.push_back(version);
+
+        // Windows showing an evicted version keep their own reference
+        while (results_order.size() > DEAD_FILES_MAX_RESULTS)
+            results.remove(results_order.takeFirst());
+    }
+
+    emit versionDone(version);
+}
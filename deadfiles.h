@@ -0,0 +1,58 @@
+#ifndef DEADFILES_H
+#define DEADFILES_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutex>
+#include <QHash>
+#include <QStringList>
+#include <memory>
+
+#include "DOA6/RdbFile.h"
+
+// Finds the dead files of a game version in the background, and keeps the results of the
+// last few versions asked, so that showing one of them again doesn't need any work.
+// Only the versions asked are analyzed, each one is a full load of the rdb.
+class DeadFilesAnalysis : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit DeadFilesAnalysis(QObject *parent = nullptr);
+    ~DeadFilesAnalysis();
+
+    // Starts the analysis of that version, unless it is done or being done already.
+    // Another rdb_path drops everything of the previous one.
+    void Request(const std::string &rdb_path, const QString &version);
+    void Clear();
+
+    bool IsDone(const QString &version) const;
+
+    // nullptr if the version isn't done or it failed to load
+    std::shared_ptr<RdbFile> GetDeadFiles(const QString &version) const;
+
+    static const QStringList &GetVersions();
+    static bool ApplyVersion(RdbFile *rdb, const QString &version);
+
+signals:
+
+    void versionDone(const QString &version);
+
+private:
+
+    QThreadPool pool;
+    mutable QMutex mutex;
+
+    std::string rdb_path;
+    QAtomicInt generation;
+
+    // These are protected by mutex
+    QStringList running;
+    QHash<QString, std::shared_ptr<RdbFile>> results;
+    QStringList results_order; // Oldest first
+
+    void AnalyzeVersion(const std::string &rdb_path, const QString &version, int gen);
+};
+
+#endif // DEADFILES_H
@@ -0,0 +1,508 @@
+#include <QThread>
+#include <QFile>
+#include <algorithm>
+
+#include "exportengine.h"
+
+#include "debug.h"
+
+// Files smaller than this don't count towards the memory budget
+#define MEMORY_BUDGET_MIN_SIZE  (1024*1024)
+
+// Small files are grouped in batches of about this size, bigger files are a batch of their own
+#define BATCH_MAX_SIZE          (4*1024*1024)
+#define BATCH_MAX_FILES         64
+
+#define PROGRESS_POLL_MS        100
+
+// Bytes of inflated files that can be waiting for the writer
+#define OUTPUT_QUEUE_SIZE       (256*1024*1024)
+
+// IO priority of the calling thread, 1 is background
+static void SetIoPriority(int priority)
+{
+#ifdef _WIN32
+    if (priority == 1)
+    {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    }
+    else
+    {
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+    }
+#else
+    Q_UNUSED(priority);
+#endif
+}
+
+ExportEngine::ExportEngine(RdbHandlePool *rdb_pool, QObject *parent) : QObject(parent), rdb_pool(rdb_pool)
+{
+    poll_timer.setInterval(PROGRESS_POLL_MS);
+    connect(&poll_timer, SIGNAL(timeout()), this, SLOT(onPoll()));
+}
+
+ExportEngine::~ExportEngine()
+{
+    // The workers use the queues and the counters of this object
+    cancelled.storeRelease(1);
+    output_queue.Abort();
+    pool.waitForDone();
+}
+
+void ExportEngine::Start(RdbFile *rdb, const std::vector<size_t> &files_idx, const std::string &out_dir, int num_threads)
+{
+    this->out_dir = out_dir;
+
+    jobs.resize(files_idx.size());
+    total_bytes = 0;
+
+    for (size_t i = 0; i < files_idx.size(); i++)
+    {
+        jobs[i].idx = files_idx[i];
+        jobs[i].size = rdb->GetEntry(files_idx[i]).file_size;
+        total_bytes += jobs[i].size;
+    }
+
+    if (memory_budget > 0)
+        memory.reset(new QSemaphore(memory_budget));
+    else
+        memory.reset();
+
+    jobs_finished.storeRelease(0);
+    bytes_finished.storeRelease(0);
+    max_jobs = (int)files_idx.size();
+    last_reported = -1;
+    stopped = false;
+    done = false;
+    cancelled.storeRelease(0);
+
+    if (max_jobs == 0)
+    {
+        done = true;
+        QMetaObject::invokeMethod(this, "finished", Qt::QueuedConnection);
+        return;
+    }
+
+    // Every worker extracts through its own RdbFile from rdb_pool, so there is no shared stream state.
+    if (num_threads <= 0)
+        num_threads = QThread::idealThreadCount();
+
+    //num_threads = 1; // For slower testing
+
+    SortJobs(rdb);
+    // Every worker loads its own rdb handle, which costs as much as opening the rdb, so there
+    // are never more workers than batches for them.
+    num_threads = MakeBatches(num_threads);
+
+    uint64_t queue_size = OUTPUT_QUEUE_SIZE;
+    if (memory_budget > 0)
+        queue_size = std::min<uint64_t>(queue_size, (uint64_t)memory_budget * 1024 * 1024);
+
+    output_queue.Reset(queue_size);
+
+    // One more thread for the writer
+    pool.setMaxThreadCount(num_threads+1);
+    workers_running = num_threads;
+
+    ExportWriter *writer = new ExportWriter(this);
+    connect(writer, SIGNAL(writerFinished()), this, SLOT(onWriterFinished()));
+    connect(writer, SIGNAL(errorSignal()), this, SLOT(onError()));
+    pool.start(writer);
+
+    for (int i = 0; i < num_threads; i++)
+    {
+        ExportWork *work = new ExportWork(this, i);
+
+        connect(work, SIGNAL(workerFinished()), this, SLOT(onWorkerFinished()));
+        connect(work, SIGNAL(errorSignal()), this, SLOT(onError()));
+        pool.start(work);
+    }
+
+    poll_timer.start();
+}
+
+void ExportEngine::SortJobs(RdbFile *rdb)
+{
+    if (order == EXPORT_ORDER_PACKAGE)
+    {
+        // Each package is read from start to end instead of jumping between them, which is
+        // what matters on a hard disk. Entries are already in package order in the rdb.
+        std::stable_sort(jobs.begin(), jobs.end(), [rdb](const ExportJob &a, const ExportJob &b)
+        {
+            const RdbEntry &entry_a = rdb->GetEntry(a.idx);
+            const RdbEntry &entry_b = rdb->GetEntry(b.idx);
+
+            if (entry_a.bin_file != entry_b.bin_file)
+                return entry_a.bin_file < entry_b.bin_file;
+
+            return a.idx < b.idx;
+        });
+    }
+    else
+    {
+        // Largest first. A big file started last would be the only thing running at the end,
+        // started first it overlaps with all the small ones.
+        std::stable_sort(jobs.begin(), jobs.end(), [](const ExportJob &a, const ExportJob &b)
+        {
+            return a.size > b.size;
+        });
+    }
+}
+
+int ExportEngine::MakeBatches(int max_workers)
+{
+    std::vector<ExportBatch> batches;
+    ExportBatch batch = { 0, 0 };
+    uint64_t batch_size = 0;
+
+    for (uint32_t i = 0; i < (uint32_t)jobs.size(); i++)
+    {
+        uint64_t size = jobs[i].size;
+
+        if (batch.count > 0 && (batch_size + size > BATCH_MAX_SIZE || batch.count == BATCH_MAX_FILES))
+        {
+            batches.push_back(batch);
+            batch = { i, 0 };
+            batch_size = 0;
+        }
+
+        batch.count++;
+        batch_size += size;
+    }
+
+    if (batch.count > 0)
+        batches.push_back(batch);
+
+    int num_workers = (int)std::min<size_t>((size_t)max_workers, batches.size());
+    queues.clear();
+
+    if (order == EXPORT_ORDER_PACKAGE)
+    {
+        // A single queue, taken from the front by all the workers, so that together they read
+        // the packages from start to end. Ranges per worker would have them read several
+        // places of the disk at once.
+        queues.emplace_back(new WorkQueue());
+
+        for (const ExportBatch &b : batches)
+            queues[0]->batches.push_back(b);
+    }
+    else
+    {
+        for (int i = 0; i < num_workers; i++)
+            queues.emplace_back(new WorkQueue());
+
+        // Round robin, so that every worker starts by one of the largest files
+        for (size_t i = 0; i < batches.size(); i++)
+            queues[i % (size_t)num_workers]->batches.push_back(batches[i]);
+    }
+
+    return num_workers;
+}
+
+bool ExportEngine::NextBatch(int worker, ExportBatch &batch)
+{
+    if (cancelled.loadAcquire())
+        return false;
+
+    int num_queues = (int)queues.size();
+    int own_queue = (num_queues == 1) ? 0 : worker;
+
+    {
+        WorkQueue *own = queues[(size_t)own_queue].get();
+        QMutexLocker locker(&own->mutex);
+
+        if (own->batches.size() > 0)
+        {
+            batch = own->batches.front();
+            own->batches.pop_front();
+            return true;
+        }
+    }
+
+    // Steal from the back of the others, which is the work they would do last
+    for (int i = 1; i < num_queues; i++)
+    {
+        WorkQueue *victim = queues[(size_t)((own_queue + i) % num_queues)].get();
+        QMutexLocker locker(&victim->mutex);
+
+        if (victim->batches.size() > 0)
+        {
+            batch = victim->batches.back();
+            victim->batches.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ExportEngine::Stop()
+{
+    stopped = true;
+    cancelled.storeRelease(1);
+    output_queue.Abort();
+    poll_timer.stop();
+
+    pool.waitForDone();
+}
+
+void ExportEngine::Cancel()
+{
+    if (stopped || done)
+        return;
+
+    Stop();
+}
+
+void ExportEngine::onPoll()
+{
+    int finished_now = jobs_finished.loadAcquire();
+
+    if (finished_now == last_reported)
+        return;
+
+    last_reported = finished_now;
+    emit progress(finished_now, max_jobs);
+}
+
+void ExportEngine::onWorkerFinished()
+{
+    // The workers only stop by themselves when there is nothing left
+    if (stopped || --workers_running > 0)
+        return;
+
+    // The writer finishes what is queued, then stops
+    output_queue.Close();
+}
+
+void ExportEngine::onWriterFinished()
+{
+    if (stopped)
+        return;
+
+    pool.waitForDone();
+
+    poll_timer.stop();
+    onPoll();
+
+    done = true;
+    emit finished();
+}
+
+void ExportEngine::onError()
+{
+    if (stopped || done)
+        return;
+
+    Stop();
+    emit error();
+}
+
+bool ExportWork::ExtractJob(RdbFile *rdb, const ExportJob &job)
+{
+    ExportOutput output;
+
+    output.size = job.size;
+    output.memory_cost = 0;
+
+    if (engine->memory && job.size >= MEMORY_BUDGET_MIN_SIZE)
+    {
+        // A file bigger than the whole budget has to go alone.
+        // It is given back by the writer, once the file is out of memory.
+        output.memory_cost = (int)std::min<uint64_t>((job.size + 1024*1024 - 1) / (1024*1024), (uint64_t)engine->memory_budget);
+
+        // Polled, so that a cancel doesn't wait for the big files that are running
+        while (!engine->memory->tryAcquire(output.memory_cost, 100))
+        {
+            if (engine->cancelled.loadAcquire())
+                return true;
+        }
+    }
+
+    rdb->GetFileName(job.idx, output.path);
+    output.path = Utils::MakePathString(engine->out_dir, output.path);
+    output.data.reset(new MemoryStream());
+
+    if (!rdb->ExtractFile(job.idx, output.data.get(), true, false))
+    {
+        if (output.memory_cost > 0)
+            engine->memory->release(output.memory_cost);
+
+        return false;
+    }
+
+    int memory_cost = output.memory_cost;
+
+    if (!engine->output_queue.Push(std::move(output)) && memory_cost > 0)
+        engine->memory->release(memory_cost); // Aborted
+
+    return true;
+}
+
+void ExportWork::run()
+{
+    ExportBatch batch;
+
+    // The handle is only taken once there is something to do with it: a worker that finds
+    // nothing left (the others stole it all) doesn't load a rdb for nothing.
+    if (!engine->NextBatch(worker, batch))
+    {
+        if (!engine->cancelled.loadAcquire())
+            emit workerFinished();
+
+        return;
+    }
+
+    RdbHandle rdb(engine->rdb_pool);
+
+    if (!rdb)
+    {
+        emit errorSignal();
+        return;
+    }
+
+    do
+    {
+        // Can be changed from the dialog at any time
+        SetIoPriority(engine->priority.loadAcquire());
+
+        for (uint32_t i = batch.first; i < batch.first+batch.count; i++)
+        {
+            if (engine->cancelled.loadAcquire())
+                return;
+
+            const ExportJob &job = engine->jobs[i];
+
+            if (!ExtractJob(rdb.get(), job))
+            {
+                if (!engine->cancelled.loadAcquire())
+                    emit errorSignal();
+
+                return;
+            }
+        }
+    } while (engine->NextBatch(worker, batch));
+
+    if (!engine->cancelled.loadAcquire())
+        emit workerFinished();
+}
+
+bool ExportWriter::Write(const ExportOutput &output)
+{
+    Utils::CreatePath(output.path);
+
+    QFile file(Utils::StdStringToQString(output.path, false));
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        DPRINTF("Cannot create file %s\n", output.path.c_str());
+        return false;
+    }
+
+    qint64 size = (qint64)output.data->GetSize();
+
+    if (file.write((const char *)output.data->GetMemory(false), size) != size)
+    {
+        DPRINTF("Failed to write file %s\n", output.path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void ExportWriter::run()
+{
+    ExportOutput output;
+
+    while (engine->output_queue.Pop(output))
+    {
+        SetIoPriority(engine->priority.loadAcquire());
+
+        bool success = Write(output);
+
+        if (output.memory_cost > 0)
+            engine->memory->release(output.memory_cost);
+
+        if (!success)
+        {
+            if (!engine->cancelled.loadAcquire())
+                emit errorSignal();
+
+            return;
+        }
+
+        // Only counters, the engine polls them
+        engine->jobs_finished.fetchAndAddRelease(1);
+        engine->bytes_finished.fetchAndAddRelease(output.size);
+
+        output.data.reset();
+    }
+
+    if (!engine->cancelled.loadAcquire())
+        emit writerFinished();
+}
+
+void ExportOutputQueue::Reset(uint64_t max_size)
+{
+    QMutexLocker locker(&mutex);
+
+    outputs.clear();
+    size = 0;
+    this->max_size = max_size;
+    closed = false;
+    aborted = false;
+}
+
+bool ExportOutputQueue::Push(ExportOutput &&output)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!aborted && outputs.size() > 0 && size + output.size > max_size)
+        not_full.wait(&mutex);
+
+    if (aborted)
+        return false;
+
+    size += output.size;
+    outputs.push_back(std::move(output));
+    not_empty.wakeOne();
+
+    return true;
+}
+
+bool ExportOutputQueue::Pop(ExportOutput &output)
+{
+    QMutexLocker locker(&mutex);
+
+    while (!aborted && !closed && outputs.size() == 0)
+        not_empty.wait(&mutex);
+
+    if (aborted || outputs.size() == 0)
+        return false;
+
+    output = std::move(outputs.front());
+    outputs.pop_front();
+    size -= output.size;
+    not_full.wakeAll();
+
+    return true;
+}
+
+void ExportOutputQueue::Close()
+{
+    QMutexLocker locker(&mutex);
+
+    closed = true;
+    not_empty.wakeAll();
+}
+
+void ExportOutputQueue::Abort()
+{
+    QMutexLocker locker(&mutex);
+
+    aborted = true;
+    outputs.clear();
+    size = 0;
+    not_empty.wakeAll();
+    not_full.wakeAll();
+}
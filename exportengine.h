@@ -0,0 +1,216 @@
+#ifndef EXPORTENGINE_H
+#define EXPORTENGINE_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <QSemaphore>
+#include <QAtomicInt>
+#include <QTimer>
+#include <QWaitCondition>
+#include <deque>
+#include <memory>
+
+#include "rdbhandlepool.h"
+#include "MemoryStream.h"
+
+class ExportEngine;
+
+struct ExportJob
+{
+    size_t idx;
+    uint64_t size;
+};
+
+// A range of ExportEngine::jobs
+struct ExportBatch
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+// A file read and inflated, waiting to be written
+struct ExportOutput
+{
+    std::string path;
+    std::unique_ptr<MemoryStream> data;
+    uint64_t size;
+    int memory_cost;
+};
+
+// Bounded (by bytes) queue between the extraction workers and the writer. A worker that
+// would go over the limit waits, unless the queue is empty, so a file bigger than the
+// limit still goes through, alone.
+class ExportOutputQueue
+{
+public:
+
+    void Reset(uint64_t max_size);
+
+    bool Push(ExportOutput &&output); // false if aborted
+    bool Pop(ExportOutput &output); // false once closed and empty, or aborted
+
+    void Close(); // No more pushes
+    void Abort();
+
+private:
+
+    QMutex mutex;
+    QWaitCondition not_empty;
+    QWaitCondition not_full;
+
+    std::deque<ExportOutput> outputs;
+    uint64_t size = 0;
+    uint64_t max_size = 0;
+    bool closed = false;
+    bool aborted = false;
+};
+
+// Writes the output files, in its own thread, while the workers read and inflate the next ones
+class ExportWriter : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+
+    ExportWriter(ExportEngine *engine) : QRunnable(), engine(engine) { }
+
+    void run();
+
+signals:
+
+    void writerFinished();
+    void errorSignal();
+
+private:
+
+    ExportEngine *engine;
+
+    bool Write(const ExportOutput &output);
+};
+
+// One of the long lived workers of an export. It keeps its rdb handle for the whole export
+// and extracts batches until there are none left, its own first, then stolen ones.
+// It only reads and inflates, the files are written by the ExportWriter.
+class ExportWork : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+
+    ExportWork(ExportEngine *engine, int worker) : QRunnable(), engine(engine), worker(worker) { }
+
+    void run();
+
+signals:
+
+    void workerFinished();
+    void errorSignal();
+
+private:
+
+    ExportEngine *engine;
+    int worker;
+
+    bool ExtractJob(RdbFile *rdb, const ExportJob &job);
+};
+
+enum
+{
+    EXPORT_ORDER_SIZE,      // Largest first
+    EXPORT_ORDER_PACKAGE,   // Grouped by package file, in rdb order inside each one
+
+    NUM_EXPORT_ORDERS
+};
+
+// Extraction engine shared by WorkerDialog and the batch (command line) mode.
+class ExportEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit ExportEngine(RdbHandlePool *rdb_pool, QObject *parent = nullptr);
+    ~ExportEngine();
+
+    void Start(RdbFile *rdb, const std::vector<size_t> &files_idx, const std::string &out_dir, int num_threads=0);
+    void Cancel();
+
+    // Read by the workers and the writer while they run
+    inline void SetPriority(int priority) { this->priority.storeRelease(priority); }
+
+    // Limits the MB of file data being extracted at once (0 = no limit). ExtractFile holds a
+    // whole file in memory, so without it a few big files at once can take several GB.
+    inline void SetMemoryBudget(int mb) { memory_budget = mb; }
+
+    inline void SetOrder(int order) { this->order = order; }
+
+    inline int GetNumJobs() const { return max_jobs; }
+    inline uint64_t GetTotalBytes() const { return total_bytes; }
+    // These can be called at any time, the workers update them with atomic adds
+    inline int GetNumFinished() const { return jobs_finished.loadAcquire(); }
+    inline uint64_t GetBytesFinished() const { return bytes_finished.loadAcquire(); }
+    inline bool IsDone() const { return (done || stopped); }
+
+signals:
+
+    // Emitted at most every PROGRESS_POLL_MS, not per file
+    void progress(int jobs_finished, int max_jobs);
+    void finished();
+    void error();
+
+private slots:
+
+    void onPoll();
+    void onWorkerFinished();
+    void onWriterFinished();
+    void onError();
+
+private:
+
+    friend class ExportWork;
+    friend class ExportWriter;
+
+    struct WorkQueue
+    {
+        QMutex mutex;
+        std::deque<ExportBatch> batches;
+    };
+
+    RdbHandlePool *rdb_pool;
+    std::string out_dir;
+
+    // Only the workers and the writer of this engine, so that waiting for them doesn't also
+    // wait for whatever else runs in the global pool
+    QThreadPool pool;
+
+    std::vector<ExportJob> jobs;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // One per worker, or one shared in package order
+    QAtomicInt cancelled;
+    ExportOutputQueue output_queue;
+
+    QAtomicInt jobs_finished;
+    QAtomicInteger<quint64> bytes_finished;
+    int max_jobs = 0;
+    uint64_t total_bytes = 0;
+
+    QTimer poll_timer;
+    int last_reported = -1;
+    int workers_running = 0;
+
+    QAtomicInt priority;
+    bool stopped = false;
+    bool done = false;
+
+    int memory_budget = 0;
+    std::unique_ptr<QSemaphore> memory;
+
+    int order = EXPORT_ORDER_SIZE;
+
+    void SortJobs(RdbFile *rdb);
+    int MakeBatches(int max_workers); // Returns the number of workers, at most one per batch
+    bool NextBatch(int worker, ExportBatch &batch);
+    void Stop();
+};
+
+#endif // EXPORTENGINE_H
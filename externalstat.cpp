@@ -0,0 +1,135 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <algorithm>
+
+#include "externalstat.h"
+
+#define STAT_BATCH_SIZE 1024
+
+struct DirListing
+{
+    qint64 dir_mtime;
+    QHash<QString, qint64> files; // name -> mtime
+};
+
+static QMutex cache_mutex;
+static QHash<QString, DirListing> cache;
+
+static inline QString FileKey(const QString &name)
+{
+#ifdef _WIN32
+    return name.toLower();
+#else
+    return name;
+#endif
+}
+
+// The cached listing of the directory while its mtime doesn't change, or a new one
+static DirListing GetListing(const QString &dir_path)
+{
+    QFileInfo dir_info(dir_path);
+    qint64 dir_mtime = (dir_info.isDir()) ? dir_info.lastModified().toMSecsSinceEpoch() : EXTERNAL_NOT_FOUND;
+
+    {
+        QMutexLocker locker(&cache_mutex);
+
+        auto it = cache.constFind(dir_path);
+        if (it != cache.constEnd() && it->dir_mtime == dir_mtime)
+            return *it;
+    }
+
+    DirListing listing;
+    listing.dir_mtime = dir_mtime;
+
+    if (dir_mtime != EXTERNAL_NOT_FOUND)
+    {
+        const QFileInfoList list = QDir(dir_path).entryInfoList(QDir::Files | QDir::Hidden | QDir::System);
+
+        listing.files.reserve(list.size());
+        for (const QFileInfo &info : list)
+            listing.files.insert(FileKey(info.fileName()), info.lastModified().toMSecsSinceEpoch());
+    }
+
+    QMutexLocker locker(&cache_mutex);
+    cache.insert(dir_path, listing);
+    return listing;
+}
+
+void ExternalStatWork::ClearCache()
+{
+    QMutexLocker locker(&cache_mutex);
+    cache.clear();
+}
+
+void ExternalStatWork::run()
+{
+    QVector<quint64> entries;
+    QVector<qint64> mtimes;
+
+    for (Request &request : requests)
+        request.path = QDir::cleanPath(QDir::fromNativeSeparators(request.path));
+
+    // By directory, then by name, so that every directory is a single run. Sorting by the
+    // whole path would put a subdirectory between files of its parent.
+    std::vector<int> slashes(requests.size());
+
+    for (size_t i = 0; i < requests.size(); i++)
+        slashes[i] = requests[i].path.lastIndexOf('/');
+
+    std::vector<size_t> order(requests.size());
+
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [this, &slashes](size_t a, size_t b)
+    {
+        const QString &path_a = requests[a].path;
+        const QString &path_b = requests[b].path;
+        int cmp = QStringRef(&path_a, 0, std::max(slashes[a], 0)).compare(QStringRef(&path_b, 0, std::max(slashes[b], 0)));
+
+        if (cmp != 0)
+            return (cmp < 0);
+
+        return (path_a < path_b);
+    });
+
+    entries.reserve(STAT_BATCH_SIZE);
+    mtimes.reserve(STAT_BATCH_SIZE);
+
+    QString current_dir;
+    DirListing listing;
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        const Request &request = requests[order[i]];
+        int slash = slashes[order[i]];
+        QString dir = (slash >= 0) ? request.path.left(slash) : QString(".");
+
+        if (i == 0 || dir != current_dir)
+        {
+            if (current_generation->loadAcquire() != generation)
+                return;
+
+            current_dir = dir;
+            listing = GetListing(dir);
+        }
+
+        qint64 mtime = listing.files.value(FileKey(request.path.mid(slash+1)), EXTERNAL_NOT_FOUND);
+
+        entries.push_back(request.idx);
+        mtimes.push_back(mtime);
+
+        if (entries.size() == STAT_BATCH_SIZE)
+        {
+            emit statsReady(generation, entries, mtimes, false);
+            entries.clear();
+            mtimes.clear();
+        }
+    }
+
+    if (current_generation->loadAcquire() == generation)
+        emit statsReady(generation, entries, mtimes, true);
+}
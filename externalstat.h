@@ -0,0 +1,51 @@
+#ifndef EXTERNALSTAT_H
+#define EXTERNALSTAT_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QVector>
+#include <QString>
+#include <vector>
+
+#define EXTERNAL_NOT_FOUND  (-1)
+
+// Gets the modification time of the external files of a rdb in a worker thread.
+// Paths are grouped by directory, and every directory is listed only once instead of
+// stat'ing its files one by one. The listings are cached and reused as they are while the
+// mtime of the directory doesn't change, otherwise the directory is listed again. A file
+// edited in place doesn't change that mtime, so its new mtime is only seen once something
+// else in the directory changes, or after ClearCache.
+class ExternalStatWork : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+
+    struct Request
+    {
+        size_t idx;
+        QString path;
+    };
+
+    ExternalStatWork(std::vector<Request> &&requests, int generation, const QAtomicInt *current_generation) :
+        QRunnable(), requests(std::move(requests)), generation(generation), current_generation(current_generation) { }
+
+    void run();
+
+    static void ClearCache();
+
+signals:
+
+    // mtimes are in ms since epoch, or EXTERNAL_NOT_FOUND
+    void statsReady(int generation, const QVector<quint64> &entries, const QVector<qint64> &mtimes, bool last);
+
+private:
+
+    std::vector<Request> requests;
+
+    int generation;
+    const QAtomicInt *current_generation;
+};
+
+#endif // EXTERNALSTAT_H
@@ -0,0 +1,47 @@
+#include "fileidindex.h"
+
+void FileIdIndex::Build(RdbFile *rdb)
+{
+    size_t num_files = rdb->GetNumFiles();
+    size_t capacity = 16;
+    int bits = 4;
+
+    // Keep the load factor at 50% or less
+    while (capacity < num_files*2)
+    {
+        capacity *= 2;
+        bits++;
+    }
+
+    slots.assign(capacity, Slot { 0, EMPTY_SLOT });
+    mask = capacity - 1;
+    shift = 32 - bits;
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        uint32_t file_id = rdb->GetEntry(i).file_id;
+
+        for (size_t pos = Hash(file_id); ; pos = (pos + 1) & mask)
+        {
+            Slot &slot = slots[pos];
+
+            if (slot.idx == EMPTY_SLOT)
+            {
+                slot.file_id = file_id;
+                slot.idx = (uint32_t)i;
+                break;
+            }
+
+            // If an id is repeated, the first entry keeps it
+            if (slot.file_id == file_id)
+                break;
+        }
+    }
+}
+
+void FileIdIndex::Clear()
+{
+    slots.clear();
+    mask = 0;
+    shift = 0;
+}
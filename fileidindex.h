@@ -0,0 +1,53 @@
+#ifndef FILEIDINDEX_H
+#define FILEIDINDEX_H
+
+#include "DOA6/RdbFile.h"
+
+// file_id -> entry index, as an open addressing (linear probing) hash table built once per rdb.
+// Find returns (size_t)-1 if not found, like RdbFile::FindFileByID.
+class FileIdIndex
+{
+public:
+
+    void Build(RdbFile *rdb);
+    void Clear();
+
+    inline size_t Find(uint32_t file_id) const
+    {
+        if (slots.size() == 0)
+            return (size_t)-1;
+
+        for (size_t pos = Hash(file_id); ; pos = (pos + 1) & mask)
+        {
+            const Slot &slot = slots[pos];
+
+            if (slot.idx == EMPTY_SLOT)
+                return (size_t)-1;
+
+            if (slot.file_id == file_id)
+                return slot.idx;
+        }
+    }
+
+private:
+
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        uint32_t file_id;
+        uint32_t idx;
+    };
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    int shift = 0;
+
+    inline size_t Hash(uint32_t file_id) const
+    {
+        // file ids are already hashes, but their low bits aren't necessarily well spread
+        return (size_t)((file_id * 0x9E3779B1u) >> shift);
+    }
+};
+
+#endif // FILEIDINDEX_H
@@ -0,0 +1,440 @@
+#include <QDateTime>
+#include <QDate>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+
+#include "filelistmodel.h"
+
+#define EXTERNAL_PENDING    (-2)
+
+void FileListModel::SetRdb(RdbFile *rdb, const std::vector<uint32_t> *name_ranks, const std::vector<uint32_t> *type_ranks)
+{
+    beginResetModel();
+
+    this->rdb = rdb;
+    size_t num_files = (rdb) ? rdb->GetNumFiles() : 0;
+
+    // Without them, sorting by name has to format every name
+    if (name_ranks && name_ranks->size() == num_files)
+        this->name_ranks = name_ranks;
+    else
+        this->name_ranks = nullptr;
+
+    if (type_ranks && type_ranks->size() == num_files)
+        this->type_ranks = type_ranks;
+    else
+        this->type_ranks = nullptr;
+
+    names.clear();
+    names.resize(num_files);
+    names_loaded.clear();
+    names_loaded.resize(num_files, false);
+    versions.clear();
+    versions.resize(num_files);
+    external_mtimes.clear();
+    external_mtimes.resize(num_files, EXTERNAL_PENDING);
+
+    rows.resize(num_files);
+    for (size_t i = 0; i < num_files; i++)
+        rows[i] = i;
+
+    SortRows();
+    endResetModel();
+}
+
+void FileListModel::SetRows(std::vector<size_t> &&entries)
+{
+    beginResetModel();
+    rows = std::move(entries);
+    SortRows();
+    endResetModel();
+}
+
+void FileListModel::AddRows(const QVector<quint64> &entries)
+{
+    if (entries.size() == 0)
+        return;
+
+    beginInsertRows(QModelIndex(), (int)rows.size(), (int)rows.size() + entries.size() - 1);
+
+    size_t first = rows.size();
+
+    for (quint64 idx : entries)
+        rows.push_back((size_t)idx);
+
+    endInsertRows();
+
+    // Rows before first are already sorted, only the new ones are sorted and merged in
+    ReorderRows(first);
+}
+
+void FileListModel::ShowAll()
+{
+    std::vector<size_t> entries;
+    size_t num_files = (rdb) ? rdb->GetNumFiles() : 0;
+
+    entries.resize(num_files);
+    for (size_t i = 0; i < num_files; i++)
+        entries[i] = i;
+
+    SetRows(std::move(entries));
+}
+
+std::vector<ExternalStatWork::Request> FileListModel::GetExternalRequests() const
+{
+    std::vector<ExternalStatWork::Request> requests;
+    size_t num_files = (rdb) ? rdb->GetNumFiles() : 0;
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        if (rdb->GetEntry(i).bin_file.length() != 0)
+            continue;
+
+        std::string ext_path = rdb->GetExternalPath(i);
+        if (ext_path.length() > 0)
+            requests.push_back({ i, Utils::StdStringToQString(ext_path) });
+    }
+
+    return requests;
+}
+
+void FileListModel::SetExternalStats(const QVector<quint64> &entries, const QVector<qint64> &mtimes, bool last)
+{
+    for (int i = 0; i < entries.size(); i++)
+    {
+        size_t idx = (size_t)entries[i];
+
+        external_mtimes[idx] = mtimes[i];
+        versions[idx] = QString();
+    }
+
+    if (rows.size() == 0)
+        return;
+
+    if (last && sort_column == COLUMN_VERSION)
+    {
+        sort(sort_column, sort_order);
+    }
+    else if (entries.size() > 0)
+    {
+        // The view only fetches again the cells it is showing
+        emit dataChanged(index(0, COLUMN_VERSION), index((int)rows.size()-1, COLUMN_VERSION));
+    }
+}
+
+const std::string &FileListModel::GetName(size_t idx) const
+{
+    if (!names_loaded[idx])
+    {
+        rdb->GetFileName(idx, names[idx]);
+        names_loaded[idx] = true;
+    }
+
+    return names[idx];
+}
+
+QString FileListModel::GetType(size_t idx) const
+{
+    const std::string &name = GetName(idx);
+    return Utils::StdStringToQString(name.substr(name.rfind('.')+1), false).toUpper();
+}
+
+QString FileListModel::GetVersion(size_t idx) const
+{
+    static const std::unordered_map<std::string, QString> pkg_to_version =
+    {
+        { "bin", "1.01" },
+        { "bin_0", "1.01" },
+        { "bin2", "1.02" },
+        { "bin2_0", "1.02" },
+        { "bin3", "1.03" },
+        { "bin3_0", "1.03" },
+        { "bin4", "1.03b" },
+        { "bin4_0", "1.03b" },
+        { "bin6", "1.04" },
+        { "bin6_0", "1.04" },
+        { "bin7", "1.04a" },
+        { "bin7_0", "1.04a" },
+        { "bin8", "1.05" },
+        { "bin8_0", "1.05" },
+        { "bin9", "1.06" },
+        { "bin9_0", "1.06" },
+        { "bin11", "1.08" },
+        { "bin11_0", "1.08" },
+        { "bin12", "1.09" },
+        { "bin12_0", "1.09" },
+        { "bin13", "1.10" },
+        { "bin13_0", "1.10" },
+        { "bin14", "1.11" },
+        { "bin14_0", "1.11" },
+        { "bin15", "1.12" },
+        { "bin15_0", "1.12" },
+        { "bin16", "1.13" },
+        { "bin16_0", "1.13" },
+        { "bin17", "1.14" },
+        { "bin17_0", "1.14" },
+        { "bin18", "1.15" },
+        { "bin18_0", "1.15" },
+        { "bin19", "1.15" },
+        { "bin19_0", "1.15" },
+        { "bin20", "1.16" },
+        { "bin20_0", "1.16" },
+        { "bin21", "1.17" },
+        { "bin21_0", "1.17" },
+        { "bin22", "1.18" },
+        { "bin22_0", "1.18" },
+        { "bin23", "1.19" },
+        { "bin23_0", "1.19" },
+        { "bin24", "1.20" },
+        { "bin24_0", "1.20" },
+        { "bin25", "1.21 "},
+        { "bin25_0", "1.21 "},
+        { "bin27", "1.22 "},
+        { "bin27_0", "1.22 "},
+    };
+
+    if (!versions[idx].isNull())
+        return versions[idx];
+
+    const RdbEntry &entry = rdb->GetEntry(idx);
+
+    QString version = Utils::StdStringToQString(entry.bin_file).mid(1);
+    auto it = pkg_to_version.find(Utils::QStringToStdString(version));
+    if (it != pkg_to_version.end())
+    {
+        version += " / " + it->second;
+    }
+
+    if (version == "")
+    {
+        qint64 mtime = external_mtimes[idx];
+
+        version = "External";
+
+        if (rdb->GetExternalPath(idx).length() == 0 || mtime == EXTERNAL_NOT_FOUND)
+        {
+            version += " (NE)";
+        }
+        else if (mtime != EXTERNAL_PENDING)
+        {
+            QDate date = QDateTime::fromMSecsSinceEpoch(mtime).date();
+            version += " (";
+            version += date.toString("yyyy/MMM/dd");
+            version += ")";
+        }
+    }
+
+    versions[idx] = version;
+    return version;
+}
+
+int FileListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return (int)rows.size();
+}
+
+int FileListModel::columnCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+
+    return NUM_COLUMNS;
+}
+
+QVariant FileListModel::data(const QModelIndex &index, int role) const
+{
+    if (!rdb || !index.isValid() || index.row() >= (int)rows.size())
+        return QVariant();
+
+    size_t idx = rows[(size_t)index.row()];
+
+    if (role == Qt::UserRole)
+        return QVariant((qulonglong)idx);
+
+    if (role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (index.column())
+    {
+        case COLUMN_NAME:
+            return Utils::StdStringToQString(GetName(idx), false);
+
+        case COLUMN_HASH:
+        {
+            char hash[16];
+
+            snprintf(hash, sizeof(hash), "0x%08x", rdb->GetEntry(idx).file_id);
+            return QString(hash);
+        }
+
+        case COLUMN_SIZE:
+            return QString("%1 bytes").arg(rdb->GetEntry(idx).file_size);
+
+        case COLUMN_TYPE:
+            return GetType(idx);
+
+        case COLUMN_VERSION:
+            return GetVersion(idx);
+    }
+
+    return QVariant();
+}
+
+QVariant FileListModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    static const char *headers[NUM_COLUMNS] = { "Name", "Hash", "Size", "Type", "Container / Version" };
+
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole || section < 0 || section >= NUM_COLUMNS)
+        return QVariant();
+
+    return QString(headers[section]);
+}
+
+void FileListModel::sort(int column, Qt::SortOrder order)
+{
+    sort_column = column;
+    sort_order = order;
+
+    ReorderRows(0);
+}
+
+void FileListModel::ReorderRows(size_t first)
+{
+    emit layoutAboutToBeChanged();
+
+    // Keep the selection and current item on the same entries
+    const QModelIndexList old_list = persistentIndexList();
+    std::vector<size_t> old_entries;
+
+    old_entries.reserve(old_list.size());
+    for (const QModelIndex &index : old_list)
+        old_entries.push_back(rows[(size_t)index.row()]);
+
+    SortRows(first);
+
+    if (old_list.size() > 0)
+    {
+        std::unordered_map<size_t, int> entry_to_row;
+        QModelIndexList new_list;
+
+        for (size_t entry : old_entries)
+            entry_to_row[entry] = -1;
+
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            auto it = entry_to_row.find(rows[i]);
+            if (it != entry_to_row.end())
+                it->second = (int)i;
+        }
+
+        new_list.reserve(old_list.size());
+        for (int i = 0; i < old_list.size(); i++)
+            new_list.push_back(index(entry_to_row[old_entries[(size_t)i]], old_list[i].column()));
+
+        changePersistentIndexList(old_list, new_list);
+    }
+
+    emit layoutChanged();
+}
+
+bool FileListModel::VersionLessThan(size_t idx1, size_t idx2) const
+{
+    const QString str1 = GetVersion(idx1);
+    const QString str2 = GetVersion(idx2);
+    bool external1 = false, external2 = false;
+
+    if (str1.startsWith("External ("))
+        external1 = true;
+
+    if (str2.startsWith("External ("))
+        external2 = true;
+
+    if (external1 && !external2)
+        return false;
+    else if (!external1 && external2)
+        return true;
+    else if (external1 && external2)
+    {
+        QString dt1_str = str1.mid(10);
+        QString dt2_str = str2.mid(10);
+
+        dt1_str.chop(1);
+        dt2_str.chop(1);
+
+        if (dt1_str == "NE")
+            return (dt2_str != "NE");
+        else if (dt2_str == "NE")
+            return false;
+
+        QDate dt1 = QDate::fromString(dt1_str, "yyyy/MMM/dd");
+        QDate dt2 = QDate::fromString(dt2_str, "yyyy/MMM/dd");
+
+        return (dt1 < dt2);
+    }
+    else
+    {
+        int pos1 = str1.indexOf(" / ");
+        int pos2 = str2.indexOf(" / ");
+
+        if (pos1 >= 0 && pos2 >= 0)
+        {
+            return (str1.mid(pos1) < str2.mid(pos2));
+        }
+    }
+
+    return (str1 < str2);
+}
+
+void FileListModel::SortRows(size_t first)
+{
+    if (!rdb || first >= rows.size() || rows.size() < 2)
+        return;
+
+    std::function<bool(size_t, size_t)> less;
+
+    switch (sort_column)
+    {
+        case COLUMN_NAME:
+            if (name_ranks)
+                less = [this](size_t a, size_t b) { return (*name_ranks)[a] < (*name_ranks)[b]; };
+            else
+                less = [this](size_t a, size_t b) { return GetName(a) < GetName(b); };
+        break;
+
+        case COLUMN_HASH:
+            less = [this](size_t a, size_t b) { return rdb->GetEntry(a).file_id < rdb->GetEntry(b).file_id; };
+        break;
+
+        case COLUMN_SIZE:
+            less = [this](size_t a, size_t b) { return rdb->GetEntry(a).file_size < rdb->GetEntry(b).file_size; };
+        break;
+
+        case COLUMN_TYPE:
+            if (type_ranks)
+                less = [this](size_t a, size_t b) { return (*type_ranks)[a] < (*type_ranks)[b]; };
+            else
+                less = [this](size_t a, size_t b) { return GetType(a) < GetType(b); };
+        break;
+
+        case COLUMN_VERSION:
+            less = [this](size_t a, size_t b) { return VersionLessThan(a, b); };
+        break;
+
+        default:
+            return;
+    }
+
+    std::function<bool(size_t, size_t)> compare = less;
+
+    if (sort_order != Qt::AscendingOrder)
+        compare = [&less](size_t a, size_t b) { return less(b, a); };
+
+    std::stable_sort(rows.begin() + (ptrdiff_t)first, rows.end(), compare);
+
+    if (first > 0)
+        std::inplace_merge(rows.begin(), rows.begin() + (ptrdiff_t)first, rows.end(), compare);
+}
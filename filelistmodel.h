@@ -0,0 +1,76 @@
+#ifndef FILELISTMODEL_H
+#define FILELISTMODEL_H
+
+#include <QAbstractTableModel>
+
+#include "DOA6/RdbFile.h"
+#include "externalstat.h"
+
+enum
+{
+    COLUMN_NAME,
+    COLUMN_HASH,
+    COLUMN_SIZE,
+    COLUMN_TYPE,
+    COLUMN_VERSION,
+
+    NUM_COLUMNS
+};
+
+// Model of the files list. It only keeps the entry index of every row, cells are formatted
+// in data(), which the view only calls for the rows it is showing.
+class FileListModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+
+    explicit FileListModel(QObject *parent = nullptr) : QAbstractTableModel(parent) { }
+
+    // name_ranks and type_ranks (see SearchEngine::GetNameRanks) are what sorts by name and
+    // by type, if given
+    void SetRdb(RdbFile *rdb, const std::vector<uint32_t> *name_ranks = nullptr, const std::vector<uint32_t> *type_ranks = nullptr);
+    void SetRows(std::vector<size_t> &&entries);
+    void AddRows(const QVector<quint64> &entries);
+    void ShowAll();
+
+    // Externals show no date until their stat arrives
+    std::vector<ExternalStatWork::Request> GetExternalRequests() const;
+    void SetExternalStats(const QVector<quint64> &entries, const QVector<qint64> &mtimes, bool last);
+
+    inline size_t GetEntryIndex(int row) const { return rows[(size_t)row]; }
+    inline const std::vector<size_t> &GetRows() const { return rows; }
+
+    const std::string &GetName(size_t idx) const;
+    QString GetType(size_t idx) const;
+    QString GetVersion(size_t idx) const;
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+private:
+
+    RdbFile *rdb = nullptr;
+    const std::vector<uint32_t> *name_ranks = nullptr;
+    const std::vector<uint32_t> *type_ranks = nullptr;
+    std::vector<size_t> rows;
+
+    // Filled on demand, per entry index
+    mutable std::vector<std::string> names;
+    mutable std::vector<bool> names_loaded;
+    mutable std::vector<QString> versions;
+    std::vector<qint64> external_mtimes;
+
+    int sort_column = COLUMN_NAME;
+    Qt::SortOrder sort_order = Qt::AscendingOrder;
+
+    // Sorts rows from first on and merges them with the ones before, which must be sorted
+    void SortRows(size_t first = 0);
+    void ReorderRows(size_t first);
+    bool VersionLessThan(size_t idx1, size_t idx2) const;
+};
+
+#endif // FILELISTMODEL_H
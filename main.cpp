@@ -1,8 +1,14 @@
 #include "mainwindow.h"
+#include "batchextract.h"
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
+    // Batch mode doesn't need (or have) a display, so it runs before any widget is created.
+    // See batchextract.h for the options, and qrdbtool_cli.pro for a console build.
+    if (IsBatchExtractCommand(argc, argv))
+        return RunBatchExtract(argc, argv);
+
     QApplication a(argc, argv);
     MainWindow w;
 
@@ -7,14 +7,14 @@
 #include <QCloseEvent>
 #include <QStyleFactory>
 #include <QLineEdit>
-#include <QProcess>
 #include <QClipboard>
 #include <QDateTime>
 #include <QDate>
 #include <QPushButton>
 #include <QComboBox>
+#include <QActionGroup>
+#include <algorithm>
 
-#include "MemoryStream.h"
 #include "debug.h"
 
 #include "workerdialog.h"
@@ -24,100 +24,38 @@
 #define PROGRAM_STATUS  " "
 //#define PROGRAM_STATUS  " "
 
-#define PREVIEW_TEXTURE_SIZE    350
-
-enum
-{
-    COLUMN_NAME,
-    COLUMN_HASH,
-    COLUMN_SIZE,
-    COLUMN_TYPE,
-    COLUMN_VERSION
-};
-
-class MyTreeWidgetItem : public QTreeWidgetItem
-{
-public:
-   MyTreeWidgetItem(QTreeWidget* parent=nullptr):QTreeWidgetItem(parent) { }
-
-private:
-
-    bool operator<(const QTreeWidgetItem &other) const
-    {
-        int column = treeWidget()->sortColumn();
-
-        if (column == COLUMN_SIZE)
-        {
-            const QString str1 = text(column);
-            const QString str2 = other.text(column);
-
-            return (str1.left(str1.indexOf(' ')).toLongLong() <  str2.left(str2.indexOf(' ')).toLongLong());
-        }
-        else if (column == COLUMN_VERSION)
-        {
-            const QString str1 = text(column);
-            const QString str2 = other.text(column);
-            bool external1 = false, external2 = false;
-
-            if (str1.startsWith("External ("))
-                external1 = true;
-
-            if (str2.startsWith("External ("))
-                external2 = true;
-
-            if (external1 && !external2)
-                return false;
-            else if (!external1 && external2)
-                return true;
-            else if (external1 && external2)
-            {
-                QString dt1_str = str1.mid(10);
-                QString dt2_str = str2.mid(10);
-
-                dt1_str.chop(1);
-                dt2_str.chop(1);
-
-                if (dt1_str == "NE")
-                    return true;
-                else if (dt2_str == "NE")
-                    return false;
-
-                QDate dt1 = QDate::fromString(dt1_str, "yyyy/MMM/dd");
-                QDate dt2 = QDate::fromString(dt2_str, "yyyy/MMM/dd");
-
-                return (dt1 < dt2);
-            }
-            else
-            {
-                int pos1 = str1.indexOf(" / ");
-                int pos2 = str2.indexOf(" / ");
-
-                if (pos1 >= 0 && pos2 >= 0)
-                {
-                    return (str1.mid(pos1) < str2.mid(pos2));
-                }
-            }
-        }
-
-        return QTreeWidgetItem::operator<(other);
-    }
-};
+// How far to look for the next and previous textures to prefetch
+#define PREFETCH_SCAN_ROWS  32
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    preview_loader(&rdb_pool)
 {
     ui->setupUi(this);
 }
 
 MainWindow::~MainWindow()
 {
+    // The workers still running hold pointers to the generation counters
+    search_generation.fetchAndAddOrdered(1);
+    stat_generation.fetchAndAddOrdered(1);
+    search_pool.waitForDone();
+    stat_pool.waitForDone();
+
     delete ui;
 }
 
 void MainWindow::SetDarkTheme()
 {
-    qApp->setStyle(QStyleFactory::create("Fusion"));
+    // Only for this window, dead files windows are dark while the main one isn't.
+    // A style isn't inherited by the children, so it is set on all of them.
+    static QStyle *fusion = QStyleFactory::create("Fusion");
+
+    setStyle(fusion);
+    for (QWidget *widget : findChildren<QWidget *>())
+        widget->setStyle(fusion);
+
     QPalette palette;
     palette.setColor(QPalette::Window, QColor(53,53,53));
     palette.setColor(QPalette::WindowText, Qt::white);
@@ -134,10 +72,10 @@ void MainWindow::SetDarkTheme()
     palette.setColor(QPalette::HighlightedText, Qt::black);
     palette.setColor(QPalette::Disabled, QPalette::Text, Qt::darkGray);
     palette.setColor(QPalette::Disabled, QPalette::ButtonText, Qt::darkGray);
-    qApp->setPalette(palette);
+    setPalette(palette);
 }
 
-bool MainWindow::Initialize()
+bool MainWindow::Initialize(bool use_args)
 {
     /*qApp->setStyle(QStyleFactory::create("Fusion"));
     QPalette palette;
@@ -165,6 +103,15 @@ bool MainWindow::Initialize()
     searchTimer.setSingleShot(true);
     connect(&searchTimer, SIGNAL(timeout()), this, SLOT(doSearch()));
 
+    qRegisterMetaType<QVector<quint64>>("QVector<quint64>");
+    search_pool.setMaxThreadCount(1);
+
+    qRegisterMetaType<QVector<qint64>>("QVector<qint64>");
+    stat_pool.setMaxThreadCount(1);
+
+    connect(&dead_files, SIGNAL(versionDone(QString)), this, SLOT(onDeadFilesDone(QString)));
+    connect(&preview_loader, SIGNAL(previewReady(PreviewResult)), this, SLOT(onPreviewReady(PreviewResult)));
+
     ui->mainToolBar->addSeparator();
     QLabel *searchLabel = new QLabel();
     searchLabel->setFixedWidth(60);
@@ -188,10 +135,15 @@ bool MainWindow::Initialize()
 
     tipLabel->setText("Tip: use Ctrl for multi-select, and shift to select a range.");
 
+    files_model = new FileListModel(this);
+    ui->filesList->setModel(files_model);
+    connect(ui->filesList->selectionModel(), SIGNAL(selectionChanged(QItemSelection,QItemSelection)), this, SLOT(onFilesSelectionChanged()));
+
     ui->filesList->sortByColumn(COLUMN_NAME, Qt::AscendingOrder);
     ui->filesList->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    ui->filesList->setSelectionBehavior(QAbstractItemView::SelectRows);
     ui->filesList->setSortingEnabled(true);
-    ui->filesList->setCurrentItem(nullptr);
+    ui->filesList->setCurrentIndex(QModelIndex());
     ui->filesList->header()->resizeSection(COLUMN_NAME, 560);
     //ui->filesList->header()->resizeSection(COLUMN_VERSION, 150);
 
@@ -235,13 +187,17 @@ bool MainWindow::Initialize()
 
     ui->previewFrame->setAutoFillBackground(true);
 
+    QActionGroup *order_group = new QActionGroup(this);
+    order_group->addAction(ui->actionOrder_largest_first);
+    order_group->addAction(ui->actionOrder_by_package);
+
     set_debug_level(2);
     QDir::setCurrent(qApp->applicationDirPath());
     LoadConfig();
 
     this->setWindowTitle(QString("%1 %2 %3").arg(PROGRAM_NAME).arg(PROGRAM_VERSION, 2).arg(PROGRAM_STATUS));
 
-    if (qApp->arguments().size() >= 2)
+    if (use_args && qApp->arguments().size() >= 2)
     {
         QString file = qApp->arguments()[1];
         QString version;
@@ -258,235 +214,80 @@ bool MainWindow::Initialize()
     return true;
 }
 
-void MainWindow::RdbEntryToGui(size_t idx, QTreeWidgetItem *item)
+void MainWindow::UnloadRdb()
 {
-    static const std::unordered_map<std::string, QString> pkg_to_version =
-    {
-        { "bin", "1.01" },
-        { "bin_0", "1.01" },
-        { "bin2", "1.02" },
-        { "bin2_0", "1.02" },
-        { "bin3", "1.03" },
-        { "bin3_0", "1.03" },
-        { "bin4", "1.03b" },
-        { "bin4_0", "1.03b" },
-        { "bin6", "1.04" },
-        { "bin6_0", "1.04" },
-        { "bin7", "1.04a" },
-        { "bin7_0", "1.04a" },
-        { "bin8", "1.05" },
-        { "bin8_0", "1.05" },
-        { "bin9", "1.06" },
-        { "bin9_0", "1.06" },
-        { "bin11", "1.08" },
-        { "bin11_0", "1.08" },
-        { "bin12", "1.09" },
-        { "bin12_0", "1.09" },
-        { "bin13", "1.10" },
-        { "bin13_0", "1.10" },
-        { "bin14", "1.11" },
-        { "bin14_0", "1.11" },
-        { "bin15", "1.12" },
-        { "bin15_0", "1.12" },
-        { "bin16", "1.13" },
-        { "bin16_0", "1.13" },
-        { "bin17", "1.14" },
-        { "bin17_0", "1.14" },
-        { "bin18", "1.15" },
-        { "bin18_0", "1.15" },
-        { "bin19", "1.15" },
-        { "bin19_0", "1.15" },
-        { "bin20", "1.16" },
-        { "bin20_0", "1.16" },
-        { "bin21", "1.17" },
-        { "bin21_0", "1.17" },
-        { "bin22", "1.18" },
-        { "bin22_0", "1.18" },
-        { "bin23", "1.19" },
-        { "bin23_0", "1.19" },
-        { "bin24", "1.20" },
-        { "bin24_0", "1.20" },
-        { "bin25", "1.21 "},
-        { "bin25_0", "1.21 "},
-        { "bin27", "1.22 "},
-        { "bin27_0", "1.22 "},
-    };
-
-    std::string name;
-    char hash[16];
-    const RdbEntry &entry = rdb->GetEntry(idx);
-    rdb->GetFileName(idx, name);
-
-    snprintf(hash, sizeof(hash), "0x%08x", entry.file_id);
-
-    QString version = Utils::StdStringToQString(entry.bin_file).mid(1);
-    auto it = pkg_to_version.find(Utils::QStringToStdString(version));
-    if (it != pkg_to_version.end())
-    {
-        version += " / " + it->second;
-    }
-
-    if (version == "")
-    {
-        bool exists = false;
+    files_model->SetRdb(nullptr);
 
-        version = "External";
+    search_generation.fetchAndAddOrdered(1);
+    search_pool.waitForDone();
+    search_engine.Clear();
+    completed_results.reset();
 
-        std::string ext_path = rdb->GetExternalPath(idx);
+    stat_generation.fetchAndAddOrdered(1);
+    preview_loader.Cancel();
+    preview_loader.Prefetch(std::vector<std::pair<size_t, uint32_t>>()); // Drops the pending ones
+    preview_loader.ClearCache();
 
-        if (ext_path.length() > 0)
-        {
-            QFileInfo info(Utils::StdStringToQString(ext_path));
-
-            if (info.exists())
-            {
-                exists = true;
+    dead_files.Clear();
+    pending_dead_versions.clear();
 
-                QDate date = info.lastModified().date();
-                version += " (";
-                version += date.toString("yyyy/MMM/dd");
-                version += ")";
-            }
-        }
-
-        if (!exists)
-            version += " (NE)";
-    }
-
-    item->setText(COLUMN_NAME, Utils::StdStringToQString(name, false));
-    item->setText(COLUMN_HASH, QString(hash));
-    item->setText(COLUMN_SIZE, QString("%1 bytes").arg(entry.file_size));
-    item->setText(COLUMN_TYPE, Utils::StdStringToQString(name.substr(name.rfind('.')+1), false).toUpper());
-    item->setText(COLUMN_VERSION, version);
+    rdb = nullptr;
+    rdb_owner.reset();
 }
 
 bool MainWindow::LoadRdb(const QString &file, const QString &version)
 {
-    if (rdb)
-        delete rdb;
+    UnloadRdb();
 
     std::string std_file = Utils::QStringToStdString(file);
-    rdb = new RdbFile(std_file);
+    std::shared_ptr<RdbFile> new_rdb = std::make_shared<RdbFile>(std_file);
 
-    if (!rdb->LoadFromFile(std_file))
+    if (!new_rdb->LoadFromFile(std_file))
         return false;
 
-    if (version == "1.01")
-    {
-        rdb->ReloadAsDeadFiles(".bin", ".bin_0");
-    }
-    else if (version == "1.02")
-    {
-        rdb->ReloadAsDeadFiles(".bin2", ".bin2_0");
-    }
-    else if (version == "1.03")
-    {
-        rdb->ReloadAsDeadFiles(".bin3", ".bin3_0");
-    }
-    else if (version == "1.03b")
-    {
-        rdb->ReloadAsDeadFiles(".bin4", ".bin4_0");
-    }
-    else if (version == "1.04")
-    {
-        rdb->ReloadAsDeadFiles(".bin6", ".bin6_0");
-    }
-    else if (version == "1.04a")
-    {
-        rdb->ReloadAsDeadFiles(".bin7", ".bin7_0");
-    }
-    else if (version == "1.05")
-    {
-        rdb->ReloadAsDeadFiles(".bin8", ".bin8_0");
-    }
-    else if (version == "1.06")
-    {
-        rdb->ReloadAsDeadFiles(".bin9", ".bin9_0");
-    }
-    else if (version == "1.08")
-    {
-        rdb->ReloadAsDeadFiles(".bin11", ".bin11_0");
-    }
-    else if (version == "1.09")
-    {
-        rdb->ReloadAsDeadFiles(".bin12", ".bin12_0");
-    }
-    else if (version == "1.10")
-    {
-        rdb->ReloadAsDeadFiles(".bin13", ".bin13_0");
-    }
-    else if (version == "1.11")
-    {
-        rdb->ReloadAsDeadFiles(".bin14", ".bin14_0");
-    }
-    else if (version == "1.12")
-    {
-        rdb->ReloadAsDeadFiles(".bin15", ".bin15_0");
-    }
-    else if (version == "1.13")
-    {
-        rdb->ReloadAsDeadFiles(".bin16", ".bin16_0");
-    }
-    else if (version == "1.14")
-    {
-        rdb->ReloadAsDeadFiles(".bin17", ".bin17_0");
-    }
-    else if (version == "1.15")
-    {
-        rdb->ReloadAsDeadFiles(".bin18", ".bin18_0", ".bin19", ".bin19_0");
-    }
-    else if (version == "1.16")
-    {
-        rdb->ReloadAsDeadFiles(".bin20", ".bin20_0");
-    }
-    else if (version == "1.17")
-    {
-        rdb->ReloadAsDeadFiles(".bin21", ".bin21_0");
-    }
-    else if (version == "1.18")
-    {
-        rdb->ReloadAsDeadFiles(".bin22", ".bin22_0");
-    }
-    else if (version == "1.19")
-    {
-        rdb->ReloadAsDeadFiles(".bin23", ".bin23_0");
-    }
-    else if (version == "1.20")
-    {
-        rdb->ReloadAsDeadFiles(".bin24", ".bin24_0");
-    }
-    else if (version == "1.21")
-    {
-        rdb->ReloadAsDeadFiles(".bin25", ".bin25_0");
-    }
-    else if (version == "1.22")
-    {
-        rdb->ReloadAsDeadFiles(".bin27", ".bin27_0");
-    }
+    DeadFilesAnalysis::ApplyVersion(new_rdb.get(), version);
 
-    if (version != "" && rdb->GetNumFiles() == 0)
+    if (version != "" && new_rdb->GetNumFiles() == 0)
     {
         DPRINTF("No dead files found for that version.\n");
         exit(-1);
     }
 
+    SetRdb(new_rdb, std_file, version);
+    return true;
+}
+
+void MainWindow::SetRdb(std::shared_ptr<RdbFile> new_rdb, const std::string &path, const QString &version)
+{
+    if (rdb)
+        UnloadRdb();
+
+    rdb_owner = new_rdb;
+    rdb = rdb_owner.get();
+
+    std::string std_file = path;
+
     last_rdb = std_file;
+    rdb_pool.Setup(std_file, version);
+    preview_loader.WarmUp();
 
     rdb_name = Utils::GetFileNameString(std_file);
     size_t last_dot = rdb_name.rfind('.');
     if (last_dot != std::string::npos)
         rdb_name = rdb_name.substr(0, last_dot);
 
-    ui->filesList->clear();
+    // The search engine builds the name order of the files list
+    search_engine.Build(rdb);
+    files_model->SetRdb(rdb, &search_engine.GetNameRanks(), &search_engine.GetTypeRanks());
 
-    for (size_t i = 0; i < rdb->GetNumFiles(); i++)
+    std::vector<ExternalStatWork::Request> stat_requests = files_model->GetExternalRequests();
+    if (stat_requests.size() > 0)
     {
-        //QTreeWidgetItem *item = new QTreeWidgetItem();
-        QTreeWidgetItem *item = new MyTreeWidgetItem();
-        item->setData(0, Qt::UserRole, QVariant(i));
+        int generation = stat_generation.fetchAndAddOrdered(1) + 1;
 
-        RdbEntryToGui(i, item);
-        ui->filesList->addTopLevelItem(item);
+        ExternalStatWork *work = new ExternalStatWork(std::move(stat_requests), generation, &stat_generation);
+        connect(work, SIGNAL(statsReady(int,QVector<quint64>,QVector<qint64>,bool)), this, SLOT(onExternalStats(int,QVector<quint64>,QVector<qint64>,bool)));
+        stat_pool.start(work);
     }
 
     ui->actionExtract_selection->setEnabled(true);
@@ -525,64 +326,59 @@ bool MainWindow::LoadRdb(const QString &file, const QString &version)
         statusLabel->setText(QString("Dead files of version %1. %2 files").arg(version).arg(rdb->GetNumFiles()));
         this->setWindowTitle(QString("%1 %2  - Dead files of version %3").arg(PROGRAM_NAME).arg(PROGRAM_VERSION, 2).arg(version));
     }
-
-    return true;
 }
 
-static bool get_hex_name(const std::string &fn, uint32_t *ret)
+size_t MainWindow::GetSelectedRows(std::vector<std::pair<int, int>> &ranges)
 {
-    if (!Utils::BeginsWith(fn, "0x", false))
-        return false;
-
-    if (fn.length() == 2)
-        return false;
+    const QItemSelection selection = ui->filesList->selectionModel()->selection();
+    size_t count = 0;
 
-    for (size_t i = 2; i < fn.length(); i++)
-    {
-        char ch = (char)tolower(fn[i]);
+    ranges.clear();
+    ranges.reserve(selection.size());
 
-        if (ch == '.')
-            break;
+    for (const QItemSelectionRange &range : selection)
+        ranges.push_back(std::make_pair(range.top(), range.bottom()));
 
-        bool ok = false;
+    // Ranges of the different columns of a row, and ranges made by ctrl+click, can overlap
+    std::sort(ranges.begin(), ranges.end());
 
-        if (ch >= '0' && ch <= '9')
-            ok = true;
-        else if (ch >= 'a' && ch <= 'f')
-            ok = true;
+    size_t num_ranges = 0;
 
-        if (!ok)
-            return false;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        if (num_ranges > 0 && ranges[i].first <= ranges[num_ranges-1].second+1)
+        {
+            ranges[num_ranges-1].second = std::max(ranges[num_ranges-1].second, ranges[i].second);
+        }
+        else
+        {
+            ranges[num_ranges++] = ranges[i];
+        }
     }
 
-    *ret = Utils::GetUnsigned(fn);
-    return true;
-}
+    ranges.resize(num_ranges);
 
-size_t MainWindow::GetSelectedHashes(std::vector<uint32_t> &hashes)
-{
-    QList<QTreeWidgetItem *> selection = ui->filesList->selectedItems();
+    for (const auto &range : ranges)
+        count += (size_t)(range.second - range.first + 1);
 
-    hashes.clear();
-    hashes.reserve(selection.size());
+    return count;
+}
 
-    for (QTreeWidgetItem *item : selection)
-    {
-        uint32_t hash;
+size_t MainWindow::GetSelectedEntries(std::vector<size_t> &entries)
+{
+    std::vector<std::pair<int, int>> ranges;
+    const std::vector<size_t> &rows = files_model->GetRows();
 
-        if (!get_hex_name(Utils::QStringToStdString(item->text(COLUMN_HASH)), &hash))
-        {
-            UPRINTF("Internal error\n");
-            return 0;
-        }
+    entries.clear();
+    entries.reserve(GetSelectedRows(ranges));
 
-        hashes.push_back(hash);
-    }
+    for (const auto &range : ranges)
+        entries.insert(entries.end(), rows.begin() + range.first, rows.begin() + range.second + 1);
 
-    return hashes.size();
+    return entries.size();
 }
 
-void MainWindow::ExtractMultiple(const std::vector<uint32_t> *hashes)
+void MainWindow::ExtractMultiple(const std::vector<size_t> *entries)
 {
     QString dir = QFileDialog::getExistingDirectory(this, "Select directory", Utils::StdStringToQString(last_dir));
     if (dir.isEmpty())
@@ -616,16 +412,17 @@ void MainWindow::ExtractMultiple(const std::vector<uint32_t> *hashes)
 
     WorkerDialog dialog(this);
 
-    if (hashes)
-        dialog.setExport(rdb, *hashes, dir_std);
+    if (entries)
+        dialog.setExport(rdb, *entries, dir_std);
     else
         dialog.setExportAll(rdb, dir_std);
 
+    dialog.setOrder(export_order);
     int ret = dialog.exec();
 
     if (ret > 0)
     {
-        UPRINTF("Files extracted succesfully.\n");
+        UPRINTF("Files extracted succesfully (%.2f MB/s).\n", dialog.GetSpeed());
     }
     else if (ret < 0)
     {
@@ -669,22 +466,21 @@ void MainWindow::on_actionExtract_selection_triggered()
     if (!rdb)
         return;
 
-    std::vector<uint32_t> hashes;
+    std::vector<size_t> entries;
 
-    if (GetSelectedHashes(hashes) == 0)
+    if (GetSelectedEntries(entries) == 0)
     {
         UPRINTF("No items are selected!");
         return;
     }
 
-    if (hashes.size() == 1)
+    if (entries.size() == 1)
     {
         std::string path;
         std::string ext;
         std::string filter;
 
-        size_t idx = rdb->FindFileByID(hashes[0]);
-        assert(idx == (size_t)-1);
+        size_t idx = entries[0];
 
         rdb->GetFileName(idx, path);
         ext = path.substr(path.rfind('.') + 1);
@@ -710,7 +506,7 @@ void MainWindow::on_actionExtract_selection_triggered()
     }
     else
     {
-        ExtractMultiple(&hashes);
+        ExtractMultiple(&entries);
     }
 }
 
@@ -728,128 +524,6 @@ void MainWindow::closeEvent(QCloseEvent *event)
     event->accept();
 }
 
-bool MainWindow::PreviewG1T(size_t g1t_idx, bool first)
-{
-    bool alpha;
-    uint32_t *dec = nullptr;
-    uint32_t w = 0, h = 0;
-
-    if (preview_array.size() > 0)
-    {
-        if (g1t_idx >= preview_array.size())
-            return false;
-
-        w = preview_g1t[0].width;
-        h = preview_g1t[0].height;
-        dec = preview_g1t.Decode(preview_array[g1t_idx], preview_g1t.CalculateTextureSize(0, true), w, h, preview_g1t[0].format, &alpha, false);
-    }
-    else
-    {
-        if (g1t_idx >= preview_g1t.GetNumTextures())
-            return false;
-
-       dec = preview_g1t.Decode(g1t_idx, &alpha, false);
-       w = preview_g1t[g1t_idx].width;
-       h = preview_g1t[g1t_idx].height;
-    }
-
-    if (!dec)
-        return false;
-
-    ui->previewFrame->setVisible(true);
-
-    QPalette p = QPalette();
-    QImage img;    
-
-    SetImage(img, dec, w, h, alpha);
-    delete[] dec;
-
-    if (w == h)
-    {
-        img = img.scaled(PREVIEW_TEXTURE_SIZE, PREVIEW_TEXTURE_SIZE);
-    }
-    else if (w > h)
-    {
-        float ratio = (float)h / (float)w;
-        img = img.scaled(PREVIEW_TEXTURE_SIZE, (int)(PREVIEW_TEXTURE_SIZE*ratio), Qt::KeepAspectRatio);
-    }
-    else
-    {
-        float ratio = (float)w / (float)h;
-        img = img.scaled((int)(PREVIEW_TEXTURE_SIZE*ratio), PREVIEW_TEXTURE_SIZE, Qt::KeepAspectRatio);
-    }
-
-    ui->previewFrame->setFixedSize(img.width(), img.height());
-
-    if (first)
-        last_preview_width = 0;
-
-    if (!this->isMaximized() && first)
-    {
-        last_preview_width = img.width();
-        this->resize(this->width() + img.width(), this->height());
-    }
-
-    p.setBrush(QPalette::Background, img);
-    ui->previewFrame->setPalette(p);
-
-    return true;
-}
-
-void MainWindow::PreviewFirstG1T(size_t rdb_idx)
-{
-    if (!rdb)
-        return;
-
-    MemoryStream out;
-
-    if (!rdb->ExtractFile(rdb_idx, &out, true, false))
-        return;
-
-    if (!preview_g1t.Load(out.GetMemory(false), out.GetSize()))
-        return;
-
-    if (preview_g1t.GetNumTextures() == 0) // Would be a weird case...
-        return;
-
-    preview_array.clear();
-
-    if (preview_g1t.GetNumTextures() == 1 && preview_g1t.IsArrayTexture(0))
-    {
-        if (!preview_g1t.DecomposeArrayTextureFast(0, preview_array, true))
-            preview_array.clear();
-    }
-
-    if (PreviewG1T(0, true) && (preview_g1t.GetNumTextures() > 1 || preview_array.size() > 0))
-    {
-        ui->previewComboBox->clear();
-
-        if (preview_array.size() > 0)
-        {
-            for (size_t i = 0; i < preview_array.size(); i++)
-            {
-                ui->previewComboBox->addItem(QString("Arr %1").arg(i));
-            }
-        }
-        else
-        {
-            for (size_t i = 0; i < preview_g1t.GetNumTextures(); i++)
-            {
-                ui->previewComboBox->addItem(QString("Tex %1").arg(i));
-            }
-        }
-
-        ui->previewComboBox->setCurrentIndex(0);
-        ui->previewComboBox->setVisible(true);
-
-        if (!this->isMaximized())
-        {
-            last_preview_width += ui->previewComboBox->width();
-            this->resize(this->width() + ui->previewComboBox->width(), this->height());
-        }
-    }
-}
-
 void MainWindow::LoadConfig()
 {
     if (!config.LoadFromFile("config.ini", false))
@@ -860,182 +534,161 @@ void MainWindow::LoadConfig()
 
     config.GetStringValue("General", "last_rdb", last_rdb);
     config.GetStringValue("General", "last_dir", last_dir);
+
+    if (!config.GetIntegerValue("Preview", "cache_mb", &preview_cache_mb) || preview_cache_mb < 0)
+        preview_cache_mb = PREVIEW_CACHE_DEFAULT_MB;
+
+    preview_loader.SetCacheBudget((size_t)preview_cache_mb * 1024 * 1024);
+
+    std::string order;
+    config.GetStringValue("Export", "order", order);
+    SetExportOrder((order == "package") ? EXPORT_ORDER_PACKAGE : EXPORT_ORDER_SIZE);
 }
 
 void MainWindow::SaveConfig()
 {
     config.SetStringValue("General", "last_rdb", last_rdb);
     config.SetStringValue("General", "last_dir", last_dir);
+    config.SetIntegerValue("Preview", "cache_mb", preview_cache_mb);
+    // Same names as the --order option of the batch mode
+    config.SetStringValue("Export", "order", (export_order == EXPORT_ORDER_PACKAGE) ? "package" : "size");
 
     config.SaveToFile("config.ini", false);
 }
 
-void MainWindow::on_actionExit_triggered()
+void MainWindow::SetExportOrder(int order)
 {
-    SaveConfig();
-    qApp->exit();
+    export_order = order;
+    ui->actionOrder_largest_first->setChecked(order == EXPORT_ORDER_SIZE);
+    ui->actionOrder_by_package->setChecked(order == EXPORT_ORDER_PACKAGE);
 }
 
-static QString WildcardToRegExp(const QString &str)
+void MainWindow::on_actionOrder_largest_first_triggered()
 {
-    QString ret = str;
-
-    int fwc = ret.indexOf('*');
-    if (fwc != -1 && fwc != 0)
-    {
-        ret.prepend('*');
-    }
+    SetExportOrder(EXPORT_ORDER_SIZE);
+    SaveConfig();
+}
 
-    int lwc = ret.lastIndexOf('*');
-    if (lwc != -1 && lwc != ret.length()-1)
-    {
-        ret += '*';
-    }
+void MainWindow::on_actionOrder_by_package_triggered()
+{
+    SetExportOrder(EXPORT_ORDER_PACKAGE);
+    SaveConfig();
+}
 
-    return ret.replace("*", ".*");
+void MainWindow::on_actionExit_triggered()
+{
+    SaveConfig();
+    qApp->exit();
 }
 
 void MainWindow::doSearch()
 {
-    /*if (searchEdit->text().isEmpty())
-        return;
-
-    QString re = WildcardToRegExp(searchEdit->text());
-
-    QList<QTreeWidgetItem *> items = ui->filesList->findItems(re, Qt::MatchRegExp, COLUMN_NAME);
-
-    if (items.size() == 0)
-        items = ui->filesList->findItems(searchEdit->text(), Qt::MatchContains, COLUMN_NAME);
+    SearchQuery query;
 
-    if (items.size() == 0)
-        items = ui->filesList->findItems(re, Qt::MatchRegExp, COLUMN_HASH);
+    if (!rdb || !SearchEngine::Compile(searchEdit->text(), query))
+        return;
 
-    if (items.size() == 0)
-        items = ui->filesList->findItems(searchEdit->text(), Qt::MatchContains, COLUMN_HASH);
+    int generation = search_generation.fetchAndAddOrdered(1) + 1;
 
-    if (items.size() >= 1)
+    if (query.IsEmpty())
     {
-        ui->filesList->scrollToItem(items[0], QAbstractItemView::PositionAtCenter);
-        items[0]->setSelected(true);
-    }
-    else
-    {
-        DPRINTF("Not found\n");
-    }*/
-
-    QString search = WildcardToRegExp(searchEdit->text()).trimmed();
-
-    if ((search.length() > 0 && search.length() < 3) || !rdb)
+        files_model->ShowAll();
         return;
+    }
 
-    ui->filesList->clear();
-
-    for (size_t i = 0; i < rdb->GetNumFiles(); i++)
-    {
-        QString name;
-        std::string name_std;
-        RdbEntry entry;
-        bool found = false;
+    // If the text was just made longer, only the results of the last search can match
+    std::shared_ptr<const std::vector<size_t>> previous;
 
-        if (search.length() == 0)
-            found = true;
+    if (completed_results && query.Refines(completed_query))
+        previous = completed_results;
 
-        QRegularExpression re = QRegularExpression(search, QRegularExpression::CaseInsensitiveOption);
+    running_query = query;
+    files_model->SetRows(std::vector<size_t>());
 
-        if (!found)
-        {
-            rdb->GetFileName(i, name_std);
-            entry = rdb->GetEntry(i);
+    SearchWork *work = new SearchWork(&search_engine, query, previous, generation, &search_generation);
+    connect(work, SIGNAL(resultsReady(int,QVector<quint64>,bool)), this, SLOT(onSearchResults(int,QVector<quint64>,bool)));
+    search_pool.start(work);
+}
 
-            name = Utils::StdStringToQString(name_std, false);
+void MainWindow::onExternalStats(int generation, const QVector<quint64> &entries, const QVector<qint64> &mtimes, bool last)
+{
+    if (generation != stat_generation.loadAcquire())
+        return;
 
-            if (name.indexOf(re) >= 0)
-            {
-                found = true;
-            }
-            else
-            {   if (name.indexOf(search, 0, Qt::CaseInsensitive) >= 0)
-                {
-                    found = true;
-                }
-            }
-        }
+    files_model->SetExternalStats(entries, mtimes, last);
+}
 
-        if (!found)
-        {
-            QString hash = Utils::StdStringToQString(Utils::UnsignedToHexString(entry.file_id, true));
+void MainWindow::onSearchResults(int generation, const QVector<quint64> &entries, bool last)
+{
+    if (generation != search_generation.loadAcquire())
+        return;
 
-            if (hash.indexOf(re) >= 0)
-            {
-                found = true;
-            }
-            else
-            {   if (hash.indexOf(search, 0, Qt::CaseInsensitive) >= 0)
-                {
-                    found = true;
-                }
-            }
-        }
+    files_model->AddRows(entries);
 
-        if (found)
-        {
-            QTreeWidgetItem *item = new MyTreeWidgetItem();
-            item->setData(0, Qt::UserRole, QVariant(i));
-
-            RdbEntryToGui(i, item);
-            ui->filesList->addTopLevelItem(item);
-        }
+    if (last)
+    {
+        completed_query = running_query;
+        completed_results = std::make_shared<const std::vector<size_t>>(files_model->GetRows());
     }
 }
 
 void MainWindow::onSearch()
 {
-    searchTimer.start(100);
+    searchTimer.start(30);
 }
 
-bool MainWindow::SetImage(QImage &image, const uint32_t *raw, uint32_t width, uint32_t height, bool alpha)
+void MainWindow::deadFilesTrigger(const QString &version)
 {
-    if (alpha)
-        image = QImage(width, height, QImage::Format_ARGB32);
-    else
-        image = QImage(width, height, QImage::Format_RGB32);
-
-    image.fill(QColor(255, 0, 255));
+    if (!rdb)
+        return;
 
-    for(uint32_t y = 0; y < height; y++)
+    // A version asked again recently is still there
+    if (dead_files.IsDone(version))
     {
-        uint8_t *lineOut = image.scanLine(y);
-        const uint8_t *lineIn = (const uint8_t *)(raw + (y*width));
-
-        for(uint32_t x = 0; x < width; x++)
-        {
-            lineOut[0] = lineIn[0];
-            lineOut[1] = lineIn[1];
-            lineOut[2] = lineIn[2];
+        ShowDeadFiles(version);
+    }
+    else if (!pending_dead_versions.contains(version))
+    {
+        dead_files.Request(last_rdb, version);
+        pending_dead_versions.push_back(version);
+        ui->statusBar->showMessage(QString("Finding dead files of version %1...").arg(version));
+    }
+}
 
-            if (alpha)
-                lineOut[3] = lineIn[3];
-            else
-                lineOut[3] = 0xFF;
+void MainWindow::onDeadFilesDone(const QString &version)
+{
+    if (!pending_dead_versions.removeOne(version))
+        return;
 
-            lineOut += 4;
-            lineIn += 4;
-        }
-    }
+    if (pending_dead_versions.isEmpty())
+        ui->statusBar->clearMessage();
 
-    return true;
+    ShowDeadFiles(version);
 }
 
-void MainWindow::deadFilesTrigger(const QString &version)
+void MainWindow::ShowDeadFiles(const QString &version)
 {
-    if (!rdb)
+    std::shared_ptr<RdbFile> dead_rdb = dead_files.GetDeadFiles(version);
+
+    if (!dead_rdb)
+    {
+        DPRINTF("Failed to find the dead files of version %s.\n", Utils::QStringToStdString(version).c_str());
         return;
+    }
 
-    QStringList args;
-    args.push_back(Utils::StdStringToQString(last_rdb));
-    args.push_back(version);
+    if (dead_rdb->GetNumFiles() == 0)
+    {
+        UPRINTF("No dead files found for version %s.\n", Utils::QStringToStdString(version).c_str());
+        return;
+    }
 
-    QProcess::startDetached(qApp->applicationFilePath(), args);
+    MainWindow *window = new MainWindow();
+
+    window->setAttribute(Qt::WA_DeleteOnClose);
+    window->Initialize(false);
+    window->SetDarkTheme();
+    window->SetRdb(dead_rdb, last_rdb, version);
+    window->show();
 }
 
 void MainWindow::on_actionFind_dead_files_1_01_triggered()
@@ -1125,14 +778,19 @@ void MainWindow::on_actionFind_dead_files_1_16_triggered()
 
 void MainWindow::on_actionCopy_name_to_clipboard_triggered()
 {
-    QList<QTreeWidgetItem *> selection = ui->filesList->selectedItems();
+    std::vector<size_t> entries;
     QString content;
 
-    for (int i = 0;  i < selection.size(); i++)
+    if (!rdb)
+        return;
+
+    GetSelectedEntries(entries);
+
+    for (size_t i = 0;  i < entries.size(); i++)
     {
-        content += selection[i]->text(0);
+        content += Utils::StdStringToQString(files_model->GetName(entries[i]), false);
 
-        if (i != (selection.size()-1))
+        if (i != (entries.size()-1))
         {
             content += '\n';
         }
@@ -1147,14 +805,19 @@ void MainWindow::on_actionCopy_name_to_clipboard_triggered()
 
 void MainWindow::on_actionCopy_hash_to_clipboard_triggered()
 {
-    QList<QTreeWidgetItem *> selection = ui->filesList->selectedItems();
+    std::vector<size_t> entries;
     QString content;
 
-    for (int i = 0;  i < selection.size(); i++)
+    if (!rdb)
+        return;
+
+    GetSelectedEntries(entries);
+
+    for (size_t i = 0;  i < entries.size(); i++)
     {
-        content += selection[i]->text(1);
+        content += QString("0x%1").arg(rdb->GetEntry(entries[i]).file_id, 8, 16, QChar('0'));
 
-        if (i != (selection.size()-1))
+        if (i != (entries.size()-1))
         {
             content += '\n';
         }
@@ -1197,7 +860,7 @@ void MainWindow::on_actionFind_dead_files_1_22_triggered()
     deadFilesTrigger("1.22");
 }
 
-void MainWindow::on_filesList_itemSelectionChanged()
+void MainWindow::onFilesSelectionChanged()
 {
     bool was_visible = ui->previewFrame->isVisible();
 
@@ -1209,22 +872,94 @@ void MainWindow::on_filesList_itemSelectionChanged()
         this->resize(this->width() - last_preview_width, this->height());
     }
 
+    // Whatever was being loaded is for the old selection
+    preview_loader.Cancel();
+    preview_row = -1;
+
     if (!rdb)
         return;
 
-    std::vector<uint32_t> hashes;
+    std::vector<std::pair<int, int>> ranges;
 
-    if (GetSelectedHashes(hashes) != 1)
+    if (GetSelectedRows(ranges) != 1)
         return;
 
-    size_t idx = rdb->FindFileByID(hashes.front());
-    if (idx == (size_t)-1)
-        return;
+    size_t idx = files_model->GetEntryIndex(ranges.front().first);
 
     if (rdb->MatchesType(idx, 0xafbec60c))
     {
-        PreviewFirstG1T(idx);
+        preview_row = ranges.front().first;
+        preview_loader.Load(idx, rdb->GetEntry(idx).file_id);
+    }
+}
+
+void MainWindow::onPreviewReady(const PreviewResult &result)
+{
+    const QImage &img = result.image;
+
+    ui->previewFrame->setVisible(true);
+    ui->previewFrame->setFixedSize(img.width(), img.height());
+
+    if (result.first)
+        last_preview_width = 0;
+
+    if (!this->isMaximized() && result.first)
+    {
+        last_preview_width = img.width();
+        this->resize(this->width() + img.width(), this->height());
+    }
+
+    QPalette p = QPalette();
+    p.setBrush(QPalette::Background, img);
+    ui->previewFrame->setPalette(p);
+
+    if (result.first && preview_row >= 0 && preview_row < files_model->rowCount() && files_model->GetEntryIndex(preview_row) == result.rdb_idx)
+        PrefetchNeighbours(preview_row);
+
+    if (result.first && (result.num_textures > 1 || result.array))
+    {
+        ui->previewComboBox->clear();
+
+        for (int i = 0; i < result.num_textures; i++)
+        {
+            ui->previewComboBox->addItem(QString("%1 %2").arg((result.array) ? "Arr" : "Tex").arg(i));
+        }
+
+        ui->previewComboBox->setCurrentIndex(0);
+        ui->previewComboBox->setVisible(true);
+
+        if (!this->isMaximized())
+        {
+            last_preview_width += ui->previewComboBox->width();
+            this->resize(this->width() + ui->previewComboBox->width(), this->height());
+        }
+    }
+}
+
+void MainWindow::PrefetchNeighbours(int row)
+{
+    std::vector<std::pair<size_t, uint32_t>> entries;
+    int num_rows = files_model->rowCount();
+
+    // The next texture first, walking down the list is the most common
+    for (int dir : { 1, -1 })
+    {
+        for (int i = 1; i <= PREFETCH_SCAN_ROWS; i++)
+        {
+            int r = row + dir*i;
+            if (r < 0 || r >= num_rows)
+                break;
+
+            size_t idx = files_model->GetEntryIndex(r);
+            if (rdb->MatchesType(idx, 0xafbec60c))
+            {
+                entries.push_back(std::make_pair(idx, rdb->GetEntry(idx).file_id));
+                break;
+            }
+        }
     }
+
+    preview_loader.Prefetch(entries);
 }
 
 void MainWindow::on_previewComboBox_currentIndexChanged(int index)
@@ -1232,5 +967,5 @@ void MainWindow::on_previewComboBox_currentIndexChanged(int index)
     if (!ui->previewComboBox->isVisible())
         return;
 
-    PreviewG1T(index, false);
+    preview_loader.ShowTexture(index);
 }
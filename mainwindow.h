@@ -3,14 +3,21 @@
 
 #include <QMainWindow>
 #include <QLabel>
-#include <QTreeWidget>
+#include <QTreeView>
 #include <QLineEdit>
 #include <QTimer>
+#include <QThreadPool>
 
 #include "DOA6/RdbFile.h"
-#include "DOA6/G1tFile.h"
 #include "IniFile.h"
 
+#include "rdbhandlepool.h"
+#include "filelistmodel.h"
+#include "searchengine.h"
+#include "deadfiles.h"
+#include "previewloader.h"
+#include "exportengine.h"
+
 namespace Ui {
 class MainWindow;
 }
@@ -23,14 +30,18 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow();
 
-    bool Initialize();
+    bool Initialize(bool use_args=true);
 
     RdbFile *rdb;
+    RdbHandlePool rdb_pool; // Per thread instances of rdb, for the workers
 
 public slots:
 
     void onSearch();
     void doSearch();
+    void onSearchResults(int generation, const QVector<quint64> &entries, bool last);
+    void onExternalStats(int generation, const QVector<quint64> &entries, const QVector<qint64> &mtimes, bool last);
+    void onPreviewReady(const PreviewResult &result);
 
 private slots:
     void on_actionOpen_triggered();
@@ -44,6 +55,7 @@ private slots:
     void on_actionExit_triggered();
 
     void deadFilesTrigger(const QString &version);
+    void onDeadFilesDone(const QString &version);
 
     void on_actionFind_dead_files_1_01_triggered();
 
@@ -95,7 +107,11 @@ private slots:
 
     void on_actionFind_dead_files_1_22_triggered();
 
-    void on_filesList_itemSelectionChanged();
+    void on_actionOrder_largest_first_triggered();
+
+    void on_actionOrder_by_package_triggered();
+
+    void onFilesSelectionChanged();
 
     void on_previewComboBox_currentIndexChanged(int index);
 
@@ -105,36 +121,56 @@ protected:
 private:
     Ui::MainWindow *ui;
 
+    FileListModel *files_model;
+    SearchEngine search_engine;
+
+    // Searches run in search_pool. Starting one makes any older one stale.
+    QThreadPool search_pool;
+    QAtomicInt search_generation;
+    SearchQuery running_query;
+    SearchQuery completed_query;
+    std::shared_ptr<const std::vector<size_t>> completed_results;
+
+    // Stats of the external files, same scheme as the searches
+    QThreadPool stat_pool;
+    QAtomicInt stat_generation;
+
     QLineEdit *searchEdit;
     QLabel *statusLabel;
+    std::shared_ptr<RdbFile> rdb_owner; // rdb, which can be shared with the dead files analysis
     std::string rdb_name;
     IniFile config;
 
+    DeadFilesAnalysis dead_files;
+    QStringList pending_dead_versions;
+
     std::string last_rdb;
     std::string last_dir;
+    int export_order = EXPORT_ORDER_SIZE;
 
-    G1tFile preview_g1t;
-    std::vector<uint8_t *> preview_array; // Only for g1t that have array
+    PreviewLoader preview_loader;
+    int preview_cache_mb = PREVIEW_CACHE_DEFAULT_MB;
+    int preview_row = -1;
     uint32_t last_preview_width;
 
     QTimer searchTimer;
 
-    bool PreviewG1T(size_t g1t_idx, bool first);
-    void PreviewFirstG1T(size_t rdb_idx);
-
     void LoadConfig();
     void SaveConfig();
+    void SetExportOrder(int order);
 
-    void RdbEntryToGui(size_t idx, QTreeWidgetItem *item);
     bool LoadRdb(const QString &file, const QString &version="");
+    void SetRdb(std::shared_ptr<RdbFile> new_rdb, const std::string &path, const QString &version);
+    void UnloadRdb();
+    void ShowDeadFiles(const QString &version);
 
-    size_t GetSelectedHashes(std::vector<uint32_t> &hashes);
-    void ExtractMultiple(const std::vector<uint32_t> *hashes);
+    size_t GetSelectedRows(std::vector<std::pair<int, int>> &ranges);
+    size_t GetSelectedEntries(std::vector<size_t> &entries);
+    void ExtractMultiple(const std::vector<size_t> *entries);
+    void PrefetchNeighbours(int row);
 
     void SetDarkTheme();
 
-    static bool SetImage(QImage &image, const uint32_t *raw, uint32_t width, uint32_t height, bool alpha);
-
 
 };
 
@@ -0,0 +1,59 @@
+#include "previewcache.h"
+
+void PreviewCache::SetBudget(size_t bytes)
+{
+    budget = bytes;
+    Trim();
+}
+
+bool PreviewCache::Get(const PreviewKey &key, Item &item)
+{
+    auto it = map.find(key);
+    if (it == map.end())
+        return false;
+
+    lru.splice(lru.begin(), lru, it->second);
+    item = it->second->second;
+    return true;
+}
+
+void PreviewCache::Put(const PreviewKey &key, const Item &item)
+{
+    size_t cost = GetCost(item);
+
+    if (cost > budget)
+        return;
+
+    auto it = map.find(key);
+    if (it != map.end())
+    {
+        size -= GetCost(it->second->second);
+        lru.erase(it->second);
+        map.erase(it);
+    }
+
+    lru.emplace_front(key, item);
+    map[key] = lru.begin();
+    size += cost;
+
+    Trim();
+}
+
+void PreviewCache::Clear()
+{
+    lru.clear();
+    map.clear();
+    size = 0;
+}
+
+void PreviewCache::Trim()
+{
+    while (size > budget && lru.size() > 0)
+    {
+        const Entry &entry = lru.back();
+
+        size -= GetCost(entry.second);
+        map.erase(entry.first);
+        lru.pop_back();
+    }
+}
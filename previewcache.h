@@ -0,0 +1,68 @@
+#ifndef PREVIEWCACHE_H
+#define PREVIEWCACHE_H
+
+#include <QImage>
+#include <list>
+#include <unordered_map>
+
+#define PREVIEW_CACHE_DEFAULT_MB    64
+
+struct PreviewKey
+{
+    uint32_t file_id;
+    int texture;
+    int slice; // -1 if not an array texture
+
+    inline bool operator==(const PreviewKey &other) const
+    {
+        return (file_id == other.file_id && texture == other.texture && slice == other.slice);
+    }
+};
+
+struct PreviewKeyHash
+{
+    inline size_t operator()(const PreviewKey &key) const
+    {
+        uint64_t h = ((uint64_t)key.file_id << 32) ^ ((uint64_t)(uint32_t)key.texture << 16) ^ (uint32_t)key.slice;
+        return std::hash<uint64_t>()(h);
+    }
+};
+
+// Least recently used cache of the already scaled preview images, bounded by the size of
+// the pixels. Along with the image it keeps the number of textures of the g1t, which is
+// what the first preview of a file needs to fill the combo box.
+// Only used from the UI thread.
+class PreviewCache
+{
+public:
+
+    struct Item
+    {
+        QImage image;
+        int num_textures;
+        bool array;
+    };
+
+    void SetBudget(size_t bytes);
+    inline size_t GetSize() const { return size; }
+
+    inline bool Contains(const PreviewKey &key) const { return (map.find(key) != map.end()); }
+    bool Get(const PreviewKey &key, Item &item);
+    void Put(const PreviewKey &key, const Item &item);
+    void Clear();
+
+private:
+
+    typedef std::pair<PreviewKey, Item> Entry;
+
+    std::list<Entry> lru; // Most recently used first
+    std::unordered_map<PreviewKey, std::list<Entry>::iterator, PreviewKeyHash> map;
+
+    size_t budget = (size_t)PREVIEW_CACHE_DEFAULT_MB * 1024 * 1024;
+    size_t size = 0;
+
+    static inline size_t GetCost(const Item &item) { return (size_t)item.image.sizeInBytes(); }
+    void Trim();
+};
+
+#endif // PREVIEWCACHE_H
@@ -0,0 +1,529 @@
+#include <QThread>
+#include <QSemaphore>
+#include <algorithm>
+#include <functional>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PREVIEW_SSE2
+#endif
+
+#include "previewloader.h"
+#include "MemoryStream.h"
+
+// Lowers the priority of the current thread while in scope
+class LowPriorityScope
+{
+public:
+
+    LowPriorityScope(bool enabled) : enabled(enabled)
+    {
+        if (enabled)
+        {
+            saved = QThread::currentThread()->priority();
+
+            // What a thread started by a pool reports, but setPriority doesn't take it
+            if (saved == QThread::InheritPriority)
+                saved = QThread::NormalPriority;
+
+            QThread::currentThread()->setPriority(QThread::LowestPriority);
+        }
+    }
+
+    ~LowPriorityScope()
+    {
+        if (enabled)
+            QThread::currentThread()->setPriority(saved);
+    }
+
+private:
+
+    bool enabled;
+    QThread::Priority saved = QThread::NormalPriority;
+};
+
+static void ForceOpaque(uint32_t *pixels, size_t count)
+{
+    size_t i = 0;
+
+#ifdef PREVIEW_SSE2
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+
+    for (; i+4 <= count; i += 4)
+    {
+        __m128i px = _mm_loadu_si128((const __m128i *)(pixels + i));
+        _mm_storeu_si128((__m128i *)(pixels + i), _mm_or_si128(px, alpha));
+    }
+#endif
+
+    for (; i < count; i++)
+        pixels[i] |= 0xFF000000;
+}
+
+// Halves a 32 bpp image averaging every 2x2 block, in place (the output is written over the
+// start of the input, which is always behind what is still to be read).
+static void DownscaleBox2x(uint32_t *pixels, uint32_t width, uint32_t height)
+{
+    uint32_t out_width = width / 2;
+    uint32_t out_height = height / 2;
+
+    for (uint32_t y = 0; y < out_height; y++)
+    {
+        const uint32_t *row0 = pixels + (size_t)(y*2) * width;
+        const uint32_t *row1 = row0 + width;
+        uint32_t *out = pixels + (size_t)y * out_width;
+        uint32_t x = 0;
+
+#ifdef PREVIEW_SSE2
+        // 8 input pixels of each row -> 4 output pixels. Channels are widened to 16 bits so
+        // that the sum of the 4 taps is exact, same as the scalar loop below.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi16(2);
+
+        for (; x+4 <= out_width; x += 4)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i *)(row0 + x*2));
+            __m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + x*2 + 4));
+            __m128i b0 = _mm_loadu_si128((const __m128i *)(row1 + x*2));
+            __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + x*2 + 4));
+
+            // Vertical sums, two pixels per register
+            __m128i v01 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+            __m128i v23 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+            __m128i v45 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+            __m128i v67 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+            // Horizontal sums: even pixels + odd pixels
+            __m128i s01 = _mm_add_epi16(_mm_unpacklo_epi64(v01, v23), _mm_unpackhi_epi64(v01, v23));
+            __m128i s23 = _mm_add_epi16(_mm_unpacklo_epi64(v45, v67), _mm_unpackhi_epi64(v45, v67));
+
+            s01 = _mm_srli_epi16(_mm_add_epi16(s01, two), 2);
+            s23 = _mm_srli_epi16(_mm_add_epi16(s23, two), 2);
+
+            _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(s01, s23));
+        }
+#endif
+
+        for (; x < out_width; x++)
+        {
+            const uint8_t *p00 = (const uint8_t *)(row0 + x*2);
+            const uint8_t *p01 = p00 + 4;
+            const uint8_t *p10 = (const uint8_t *)(row1 + x*2);
+            const uint8_t *p11 = p10 + 4;
+            uint8_t *o = (uint8_t *)(out + x);
+
+            for (int c = 0; c < 4; c++)
+                o[c] = (uint8_t)((p00[c] + p01[c] + p10[c] + p11[c] + 2) >> 2);
+        }
+    }
+}
+
+static void FreeDecoded(void *info)
+{
+    delete[] (uint32_t *)info;
+}
+
+void PreviewWork::run()
+{
+    if (IsStale())
+        return;
+
+    // Only prefetch work is lowered, and the thread gets its priority back on any return
+    LowPriorityScope priority_scope(prefetch);
+
+    if (!source->loaded && !LoadSource())
+        return;
+
+    QImage image;
+
+    if (source->failed || IsStale() || !Decode(image))
+        return;
+
+    uint32_t w = (uint32_t)image.width();
+    uint32_t h = (uint32_t)image.height();
+
+    if (w == h)
+    {
+        image = image.scaled(PREVIEW_TEXTURE_SIZE, PREVIEW_TEXTURE_SIZE);
+    }
+    else if (w > h)
+    {
+        float ratio = (float)h / (float)w;
+        image = image.scaled(PREVIEW_TEXTURE_SIZE, (int)(PREVIEW_TEXTURE_SIZE*ratio), Qt::KeepAspectRatio);
+    }
+    else
+    {
+        float ratio = (float)w / (float)h;
+        image = image.scaled((int)(PREVIEW_TEXTURE_SIZE*ratio), PREVIEW_TEXTURE_SIZE, Qt::KeepAspectRatio);
+    }
+
+    if (IsStale())
+        return;
+
+    PreviewResult result;
+
+    result.rdb_idx = source->rdb_idx;
+    result.file_id = source->file_id;
+    result.texture = texture;
+    result.array = (source->array.size() > 0);
+    result.num_textures = (result.array) ? (int)source->array.size() : (int)source->g1t.GetNumTextures();
+    result.first = (texture < 0);
+    result.image = image;
+
+    if (result.first)
+        result.texture = 0;
+
+    emit workReady(generation, result);
+}
+
+bool PreviewWork::LoadSource()
+{
+    // Only called by the work that does the first preview of the entry. loaded is only set
+    // once the outcome is known: a stale work leaves it for the next one to try again.
+    MemoryStream out;
+
+    // A preview asked while the handle is being warmed up waits for it, rather than loading
+    // a second one
+    if (warm_up_pool)
+        warm_up_pool->waitForDone();
+
+    {
+        // Prefetching 32 rows must not load new handles (a whole rdb each), it only goes on
+        // when a loaded one is free. The source is its own, nothing is marked as failed.
+        RdbHandle rdb(rdb_pool, prefetch);
+
+        if (!rdb && prefetch)
+            return false;
+
+        if (!rdb || !rdb->ExtractFile(source->rdb_idx, &out, true, false))
+            return SetLoaded(false);
+    }
+
+    if (IsStale())
+        return false;
+
+    if (!source->g1t.Load(out.GetMemory(false), out.GetSize()))
+        return SetLoaded(false);
+
+    if (source->g1t.GetNumTextures() == 0) // Would be a weird case...
+        return SetLoaded(false);
+
+    source->array.clear();
+
+    if (source->g1t.GetNumTextures() == 1 && source->g1t.IsArrayTexture(0))
+    {
+        if (!source->g1t.DecomposeArrayTextureFast(0, source->array, true))
+            source->array.clear();
+    }
+
+    return SetLoaded(true);
+}
+
+bool PreviewWork::SetLoaded(bool success)
+{
+    source->failed = !success;
+    source->loaded = true;
+    return success;
+}
+
+// Takes a handle from the pool and gives it back, so that it is already loaded when the first
+// preview needs it
+class PoolWarmUpWork : public QRunnable
+{
+public:
+
+    PoolWarmUpWork(RdbHandlePool *rdb_pool) : rdb_pool(rdb_pool) { }
+    void run() override { RdbHandle rdb(rdb_pool); }
+
+private:
+
+    RdbHandlePool *rdb_pool;
+};
+
+class DecodeBandWork : public QRunnable
+{
+public:
+
+    DecodeBandWork(const std::function<void()> &func) : func(func) { }
+    void run() override { func(); }
+
+private:
+
+    std::function<void()> func;
+};
+
+uint32_t *PreviewWork::DecodeSliceInBands(QThreadPool *band_pool, uint8_t *buf, uint32_t size, uint32_t width, uint32_t height, uint8_t format, bool *alpha, size_t min_pixels)
+{
+    // Never more bands than cores: the band pool has a thread even on a single core machine,
+    // where splitting only adds copies
+    int num_threads = (band_pool) ? std::min(band_pool->maxThreadCount() + 1, QThread::idealThreadCount()) : 1;
+    uint32_t block_rows = height / 4;
+
+    if (num_threads < 2 || (size_t)width*height < min_pixels || block_rows == 0 || (height % 4) != 0 || (size % block_rows) != 0)
+    {
+        G1tFile decoder;
+        return decoder.Decode(buf, size, width, height, format, alpha, false);
+    }
+
+    uint32_t block_row_size = size / block_rows;
+    uint32_t band_block_rows = (block_rows + (uint32_t)num_threads - 1) / (uint32_t)num_threads;
+    uint32_t num_bands = (block_rows + band_block_rows - 1) / band_block_rows;
+
+    uint32_t *out = new uint32_t[(size_t)width*height];
+    // Not vector<bool>, every thread writes its own element
+    std::vector<uint8_t> band_ok(num_bands, 0);
+    std::vector<uint8_t> band_alpha(num_bands, 0);
+    QSemaphore done;
+
+    auto decode_band = [&](uint32_t band)
+    {
+        uint32_t first = band * band_block_rows;
+        uint32_t count = std::min(band_block_rows, block_rows - first);
+        bool a;
+
+        // Every band has its own G1tFile: Decode is not const, so nothing says that it
+        // doesn't keep state in the object.
+        G1tFile decoder;
+
+        uint32_t *dec = decoder.Decode(buf + (size_t)first*block_row_size, count*block_row_size, width, count*4, format, &a, false);
+        if (dec)
+        {
+            memcpy(out + (size_t)first*4*width, dec, (size_t)count*4*width*sizeof(uint32_t));
+            delete[] dec;
+
+            band_ok[band] = 1;
+            band_alpha[band] = (a) ? 1 : 0;
+        }
+    };
+
+    for (uint32_t band = 1; band < num_bands; band++)
+    {
+        band_pool->start(new DecodeBandWork([&decode_band, &done, band]()
+        {
+            decode_band(band);
+            done.release();
+        }));
+    }
+
+    decode_band(0);
+    done.acquire((int)num_bands-1);
+
+    if (std::find(band_ok.begin(), band_ok.end(), 0) != band_ok.end())
+    {
+        delete[] out;
+        return nullptr;
+    }
+
+    // The image has alpha if any band has it
+    *alpha = (std::find(band_alpha.begin(), band_alpha.end(), 1) != band_alpha.end());
+    return out;
+}
+
+bool PreviewWork::Decode(QImage &image)
+{
+    G1tFile &g1t = source->g1t;
+    size_t idx = (texture < 0) ? 0 : (size_t)texture;
+
+    bool alpha;
+    uint32_t *dec = nullptr;
+    uint32_t w = 0, h = 0;
+
+    if (source->array.size() > 0)
+    {
+        if (idx >= source->array.size())
+            return false;
+
+        w = g1t[0].width;
+        h = g1t[0].height;
+        dec = DecodeSliceInBands(band_pool, source->array[idx], g1t.CalculateTextureSize(0, true), w, h, g1t[0].format, &alpha);
+    }
+    else
+    {
+        if (idx >= g1t.GetNumTextures())
+            return false;
+
+        // Single thread. Banding needs the raw bytes of mip 0, and G1tFile only hands them
+        // out for array slices (DecomposeArrayTextureFast); other textures are decoded from
+        // its own copy, by index.
+
+        dec = g1t.Decode(idx, &alpha, false);
+        w = g1t[idx].width;
+        h = g1t[idx].height;
+    }
+
+    if (!dec)
+        return false;
+
+    // Bring it close to the preview size cheaply, Qt only does the last step.
+    // This is what picking the smallest mip of at least that size would give.
+    while (std::max(w, h) / 2 >= PREVIEW_TEXTURE_SIZE && std::min(w, h) >= 2)
+    {
+        DownscaleBox2x(dec, w, h);
+        w /= 2;
+        h /= 2;
+    }
+
+    return SetImage(image, dec, w, h, alpha);
+}
+
+bool PreviewWork::SetImage(QImage &image, uint32_t *raw, uint32_t width, uint32_t height, bool alpha)
+{
+    // The decoder output already has the memory layout of ARGB32, so the image just uses it.
+    // RGB32 must still have its alpha byte at 0xFF.
+    if (!alpha)
+        ForceOpaque(raw, (size_t)width * height);
+
+    image = QImage((uchar *)raw, (int)width, (int)height, (int)width*4, (alpha) ? QImage::Format_ARGB32 : QImage::Format_RGB32, FreeDecoded, raw);
+    if (image.isNull())
+    {
+        delete[] raw;
+        return false;
+    }
+
+    return true;
+}
+
+PreviewLoader::PreviewLoader(RdbHandlePool *rdb_pool, QObject *parent) : QObject(parent), rdb_pool(rdb_pool)
+{
+    qRegisterMetaType<PreviewResult>("PreviewResult");
+
+    // One at a time: the works of an entry share its PreviewSource, and a stale one
+    // gives up quickly anyway.
+    pool.setMaxThreadCount(1);
+    prefetch_pool.setMaxThreadCount(1);
+    warm_up_pool.setMaxThreadCount(1);
+
+    // Its own pool, the global one is the export's, which may be waited for or resized
+    // at any time. The preview thread itself does one band.
+    band_pool.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+}
+
+PreviewLoader::~PreviewLoader()
+{
+    Cancel();
+    prefetch_generation.fetchAndAddOrdered(1);
+    prefetch_pool.clear();
+
+    pool.waitForDone();
+    prefetch_pool.waitForDone();
+    warm_up_pool.waitForDone();
+}
+
+void PreviewLoader::WarmUp()
+{
+    // Not in pool, whose queue is cleared by every new preview. The previews wait for it
+    // instead (see LoadSource).
+    warm_up_pool.start(new PoolWarmUpWork(rdb_pool));
+}
+
+void PreviewLoader::Load(size_t rdb_idx, uint32_t file_id)
+{
+    source = std::make_shared<PreviewSource>(rdb_idx, file_id);
+    source_array = false;
+
+    // Whether it is an array isn't known yet, the first texture may be cached as either
+    if (FromCache(MakeKey(file_id, 0, false), 0, true) || FromCache(MakeKey(file_id, 0, true), 0, true))
+        return;
+
+    StartWork(-1);
+}
+
+void PreviewLoader::ShowTexture(int texture)
+{
+    if (!source || texture < 0)
+        return;
+
+    if (FromCache(MakeKey(source->file_id, texture, source_array), texture, false))
+        return;
+
+    StartWork(texture);
+}
+
+bool PreviewLoader::FromCache(const PreviewKey &key, int texture, bool first)
+{
+    PreviewCache::Item item;
+
+    if (!cache.Get(key, item))
+        return false;
+
+    // Anything still running is for another texture
+    generation.fetchAndAddOrdered(1);
+    pool.clear();
+
+    PreviewResult result;
+
+    result.rdb_idx = source->rdb_idx;
+    result.file_id = source->file_id;
+    result.texture = texture;
+    result.num_textures = item.num_textures;
+    result.array = item.array;
+    result.first = first;
+    result.image = item.image;
+
+    source_array = item.array;
+
+    emit previewReady(result);
+    return true;
+}
+
+void PreviewLoader::Cancel()
+{
+    generation.fetchAndAddOrdered(1);
+    pool.clear();
+    source.reset();
+}
+
+void PreviewLoader::Prefetch(const std::vector<std::pair<size_t, uint32_t>> &entries)
+{
+    int gen = prefetch_generation.fetchAndAddOrdered(1) + 1;
+    prefetch_pool.clear();
+
+    for (const auto &entry : entries)
+    {
+        if (IsCached(entry.second))
+            continue;
+
+        std::shared_ptr<PreviewSource> prefetch_source = std::make_shared<PreviewSource>(entry.first, entry.second);
+
+        PreviewWork *work = new PreviewWork(rdb_pool, prefetch_source, -1, gen, &prefetch_generation, true);
+        connect(work, SIGNAL(workReady(int,PreviewResult)), this, SLOT(onPrefetchReady(int,PreviewResult)));
+        prefetch_pool.start(work);
+    }
+}
+
+bool PreviewLoader::IsCached(uint32_t file_id)
+{
+    return (cache.Contains(MakeKey(file_id, 0, false)) || cache.Contains(MakeKey(file_id, 0, true)));
+}
+
+void PreviewLoader::StartWork(int texture)
+{
+    int gen = generation.fetchAndAddOrdered(1) + 1;
+
+    // Whatever is still queued is stale already
+    pool.clear();
+
+    PreviewWork *work = new PreviewWork(rdb_pool, source, texture, gen, &generation, false, &band_pool, &warm_up_pool);
+    connect(work, SIGNAL(workReady(int,PreviewResult)), this, SLOT(onWorkReady(int,PreviewResult)));
+    pool.start(work);
+}
+
+void PreviewLoader::onWorkReady(int generation, const PreviewResult &result)
+{
+    if (generation != this->generation.loadAcquire())
+        return;
+
+    cache.Put(MakeKey(result.file_id, result.texture, result.array), { result.image, result.num_textures, result.array });
+    source_array = result.array;
+
+    emit previewReady(result);
+}
+
+void PreviewLoader::onPrefetchReady(int generation, const PreviewResult &result)
+{
+    if (generation != prefetch_generation.loadAcquire())
+        return;
+
+    cache.Put(MakeKey(result.file_id, result.texture, result.array), { result.image, result.num_textures, result.array });
+}
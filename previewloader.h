@@ -0,0 +1,158 @@
+#ifndef PREVIEWLOADER_H
+#define PREVIEWLOADER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QImage>
+#include <memory>
+
+#include "DOA6/G1tFile.h"
+#include "rdbhandlepool.h"
+#include "previewcache.h"
+
+#define PREVIEW_TEXTURE_SIZE    350
+
+// Array slices smaller than this are decoded by a single thread
+#define DECODE_BANDS_MIN_PIXELS (1024*1024)
+
+// A decoded texture, already scaled to the preview size
+struct PreviewResult
+{
+    size_t rdb_idx = 0;
+    uint32_t file_id = 0;
+    int texture = 0;
+    int num_textures = 0; // Textures, or slices of the array texture
+    bool array = false;
+    bool first = false; // First preview of this entry
+    QImage image;
+};
+
+Q_DECLARE_METATYPE(PreviewResult)
+
+// The g1t of the entry being previewed. It stays loaded so that switching to another
+// texture only has to decode.
+struct PreviewSource
+{
+    size_t rdb_idx;
+    uint32_t file_id;
+    bool loaded = false;
+    bool failed = false;
+
+    G1tFile g1t;
+    std::vector<uint8_t *> array; // Only for g1t that have array
+
+    PreviewSource(size_t rdb_idx, uint32_t file_id) : rdb_idx(rdb_idx), file_id(file_id) { }
+};
+
+class PreviewWork : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+
+    PreviewWork(RdbHandlePool *rdb_pool, std::shared_ptr<PreviewSource> source, int texture, int generation, const QAtomicInt *current_generation, bool prefetch=false, QThreadPool *band_pool=nullptr, QThreadPool *warm_up_pool=nullptr) :
+        QRunnable(), rdb_pool(rdb_pool), source(source), texture(texture), generation(generation), current_generation(current_generation), prefetch(prefetch), band_pool(band_pool), warm_up_pool(warm_up_pool) { }
+
+    void run();
+
+    // Takes ownership of raw (allocated with new[]), the image uses it without copying
+    static bool SetImage(QImage &image, uint32_t *raw, uint32_t width, uint32_t height, bool alpha);
+
+    // Decodes mip 0 of an array slice on several threads, every thread doing a band of rows.
+    // Blocks never cross a band (bands are a multiple of 4 rows), so the result is the same as
+    // decoding it in one go. Small slices, or sizes that can't be split exactly, go in one go.
+    // The calling thread does the first band, band_pool the others. Returns a new[] buffer.
+    static uint32_t *DecodeSliceInBands(QThreadPool *band_pool, uint8_t *buf, uint32_t size, uint32_t width, uint32_t height, uint8_t format, bool *alpha, size_t min_pixels = DECODE_BANDS_MIN_PIXELS);
+
+signals:
+
+    void workReady(int generation, const PreviewResult &result);
+
+private:
+
+    RdbHandlePool *rdb_pool;
+    std::shared_ptr<PreviewSource> source;
+    int texture;
+
+    int generation;
+    const QAtomicInt *current_generation;
+    // Prefetch work runs at low priority, and only with a rdb handle that is already loaded
+    bool prefetch;
+    QThreadPool *band_pool; // Large array slices are decoded in bands with it, if not null
+    QThreadPool *warm_up_pool; // Waited for before taking a rdb handle, if not null
+
+    inline bool IsStale() const { return (current_generation->loadAcquire() != generation); }
+
+    bool LoadSource();
+    bool SetLoaded(bool success);
+    bool Decode(QImage &image);
+};
+
+// Extracts and decodes the g1t previews in a worker thread. Only the newest request matters:
+// a new one makes the older ones stale, and they give up at the next step or are dropped
+// when they arrive, so previewReady only ever delivers the image of the current selection.
+class PreviewLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit PreviewLoader(RdbHandlePool *rdb_pool, QObject *parent = nullptr);
+    ~PreviewLoader();
+
+    // Loads a handle of the rdb pool in the background, right after the pool is set up, so that
+    // the first preview doesn't have to parse the rdb (and find the dead files) again
+    void WarmUp();
+
+    // First texture of an entry
+    void Load(size_t rdb_idx, uint32_t file_id);
+    // Another texture of the entry of the last Load
+    void ShowTexture(int texture);
+    void Cancel();
+
+    // Decodes the first texture of these entries in the background, at low priority, so that
+    // they are already in the cache when selected. Replaces the previous list.
+    void Prefetch(const std::vector<std::pair<size_t, uint32_t>> &entries);
+
+    // Images already shown are kept, up to this size, and come back without any decoding
+    inline void SetCacheBudget(size_t bytes) { cache.SetBudget(bytes); }
+    inline void ClearCache() { cache.Clear(); }
+
+signals:
+
+    void previewReady(const PreviewResult &result);
+
+private slots:
+
+    void onWorkReady(int generation, const PreviewResult &result);
+    void onPrefetchReady(int generation, const PreviewResult &result);
+
+private:
+
+    RdbHandlePool *rdb_pool;
+    QThreadPool pool;
+    QAtomicInt generation;
+
+    std::shared_ptr<PreviewSource> source;
+    bool source_array = false; // As reported by the first preview of source
+    PreviewCache cache;
+
+    QThreadPool prefetch_pool;
+    QThreadPool band_pool;
+    // Apart from pool, so that a Cancel or a new preview doesn't drop a queued warm up
+    QThreadPool warm_up_pool;
+    QAtomicInt prefetch_generation;
+
+    static inline PreviewKey MakeKey(uint32_t file_id, int texture, bool array)
+    {
+        return (array) ? PreviewKey{ file_id, 0, texture } : PreviewKey{ file_id, texture, -1 };
+    }
+
+    bool IsCached(uint32_t file_id);
+    bool FromCache(const PreviewKey &key, int texture, bool first);
+    void StartWork(int texture);
+};
+
+#endif // PREVIEWLOADER_H
@@ -8,6 +8,9 @@ QT       += core gui
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
+# Qt::SkipEmptyParts (batch mode) is new in 5.14
+lessThan(QT_MAJOR_VERSION, 5)|if(equals(QT_MAJOR_VERSION, 5):lessThan(QT_MINOR_VERSION, 14)): error("qrdbtool requires Qt 5.14 or newer")
+
 TARGET = qrdbtool
 TEMPLATE = app
 
@@ -43,9 +46,19 @@ SOURCES += \
         ../eternity_common/tinyxml/tinyxml.cpp \
         ../eternity_common/tinyxml/tinyxmlerror.cpp \
         ../eternity_common/tinyxml/tinyxmlparser.cpp \
+        batchextract.cpp \
+        deadfiles.cpp \
         debug.cpp \
+        exportengine.cpp \
+        externalstat.cpp \
+        fileidindex.cpp \
+        filelistmodel.cpp \
         main.cpp \
         mainwindow.cpp \
+        previewcache.cpp \
+        previewloader.cpp \
+        rdbhandlepool.cpp \
+        searchengine.cpp \
         workerdialog.cpp
 
 HEADERS += \
@@ -70,7 +83,17 @@ HEADERS += \
         ../eternity_common/tinyxml/tinystr.h \
         ../eternity_common/tinyxml/tinyxml.h \
         ../eternity_common/vs/dirent.h \
+        batchextract.h \
+        deadfiles.h \
+        exportengine.h \
+        externalstat.h \
+        fileidindex.h \
+        filelistmodel.h \
         mainwindow.h \
+        previewcache.h \
+        previewloader.h \
+        rdbhandlepool.h \
+        searchengine.h \
         workerdialog.h
 
 FORMS += \
@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# Console build of qrdbtool, for the batch mode: on Windows, qrdbtool is a GUI
+# subsystem executable, and its stdout doesn't reach the console it was started from.
+# Same sources and options, it still opens the GUI when run without --extract.
+# Use its own build directory, the object files would clash with the GUI build.
+#
+#-------------------------------------------------
+
+include(qrdbtool.pro)
+
+TARGET = qrdbtool-cli
+
+CONFIG -= windows
+CONFIG += console
@@ -0,0 +1,97 @@
+#include "rdbhandlepool.h"
+#include "deadfiles.h"
+
+RdbHandlePool::~RdbHandlePool()
+{
+    Clear();
+}
+
+void RdbHandlePool::Setup(const std::string &rdb_path, const QString &version)
+{
+    Clear();
+
+    QMutexLocker locker(&mutex);
+    this->rdb_path = rdb_path;
+    this->version = version;
+}
+
+void RdbHandlePool::Clear()
+{
+    QMutexLocker locker(&mutex);
+
+    for (RdbFile *handle : free_handles)
+        delete handle;
+
+    free_handles.clear();
+    generation++; // Handles still in use will be deleted on release
+}
+
+RdbFile *RdbHandlePool::Acquire()
+{
+    std::string path;
+    QString ver;
+    uint32_t gen;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        if (free_handles.size() > 0)
+        {
+            RdbFile *handle = free_handles.back();
+            free_handles.pop_back();
+            busy_handles[handle] = generation;
+            return handle;
+        }
+
+        path = rdb_path;
+        ver = version;
+        gen = generation;
+    }
+
+    if (path.length() == 0)
+        return nullptr;
+
+    // Loading is done outside the lock, so that several threads starting at the same time
+    // don't wait for each other.
+    RdbFile *handle = new RdbFile(path);
+
+    if (!handle->LoadFromFile(path) || !DeadFilesAnalysis::ApplyVersion(handle, ver))
+    {
+        delete handle;
+        return nullptr;
+    }
+
+    QMutexLocker locker(&mutex);
+    busy_handles[handle] = gen;
+    return handle;
+}
+
+RdbFile *RdbHandlePool::TryAcquire()
+{
+    QMutexLocker locker(&mutex);
+
+    if (free_handles.size() == 0)
+        return nullptr;
+
+    RdbFile *handle = free_handles.back();
+    free_handles.pop_back();
+    busy_handles[handle] = generation;
+    return handle;
+}
+
+void RdbHandlePool::Release(RdbFile *handle)
+{
+    QMutexLocker locker(&mutex);
+
+    auto it = busy_handles.find(handle);
+    if (it == busy_handles.end())
+        return;
+
+    bool stale = (it->second != generation);
+    busy_handles.erase(it);
+
+    if (stale)
+        delete handle;
+    else
+        free_handles.push_back(handle);
+}
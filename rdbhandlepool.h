@@ -0,0 +1,61 @@
+#ifndef RDBHANDLEPOOL_H
+#define RDBHANDLEPOOL_H
+
+#include <QMutex>
+#include <QString>
+#include <unordered_map>
+
+#include "DOA6/RdbFile.h"
+
+// RdbFile keeps its package streams and decompression state inside the object, so a single
+// instance can't be used from several threads at once. This pool hands each worker its own
+// instance, loaded from the same rdb (and dead files version), and keeps them around so the
+// next job on that thread doesn't have to parse the rdb again.
+class RdbHandlePool
+{
+public:
+
+    RdbHandlePool() { }
+    ~RdbHandlePool();
+
+    void Setup(const std::string &rdb_path, const QString &version);
+    void Clear();
+
+    RdbFile *Acquire();
+    // Only a handle that is already loaded, or nullptr: never loads the rdb
+    RdbFile *TryAcquire();
+    void Release(RdbFile *handle);
+
+private:
+
+    QMutex mutex;
+    std::string rdb_path;
+    QString version;
+
+    std::vector<RdbFile *> free_handles;
+    // Handles that are out, and the setup they were loaded for
+    std::unordered_map<RdbFile *, uint32_t> busy_handles;
+    uint32_t generation = 0;
+};
+
+class RdbHandle
+{
+public:
+
+    RdbHandle(RdbHandlePool *pool, bool loaded_only = false) : pool(pool) { handle = (loaded_only) ? pool->TryAcquire() : pool->Acquire(); }
+    ~RdbHandle() { if (handle) pool->Release(handle); }
+
+    RdbFile *operator->() const { return handle; }
+    RdbFile *get() const { return handle; }
+    explicit operator bool() const { return (handle != nullptr); }
+
+private:
+
+    RdbHandlePool *pool;
+    RdbFile *handle;
+
+    RdbHandle(const RdbHandle &) = delete;
+    RdbHandle &operator=(const RdbHandle &) = delete;
+};
+
+#endif // RDBHANDLEPOOL_H
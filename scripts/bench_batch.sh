@@ -0,0 +1,45 @@
+#!/bin/sh
+# Throughput of the batch extraction for every value of one of its options, --threads by default.
+# Usage: bench_batch.sh file.rdb out_dir [runs] [extra qrdbtool options...]
+# OPTION is the option to vary (default: --threads), VALUES its values (default: 1 2 4 8 16),
+# e.g. OPTION=--order VALUES="size package". QRDBTOOL can point to the executable (default:
+# qrdbtool in the PATH). The out_dir is deleted before every run.
+
+if [ $# -lt 2 ]; then
+    echo "Usage: $0 file.rdb out_dir [runs] [extra qrdbtool options...]" >&2
+    exit 1
+fi
+
+RDB="$1"
+OUT="$2"
+RUNS="${3:-3}"
+shift 2
+[ $# -gt 0 ] && shift
+
+QRDBTOOL="${QRDBTOOL:-qrdbtool}"
+OPTION="${OPTION:---threads}"
+VALUES="${VALUES:-1 2 4 8 16}"
+
+echo "${OPTION#--},run,files,seconds,files_per_sec,mb_per_sec"
+
+for value in $VALUES; do
+    run=1
+    while [ "$run" -le "$RUNS" ]; do
+        rm -rf "$OUT"
+        # Best effort, so that every run starts with the rdb out of the page cache as the first one did
+        sync
+        [ -w /proc/sys/vm/drop_caches ] && echo 3 > /proc/sys/vm/drop_caches
+
+        done_line=$("$QRDBTOOL" --extract "$RDB" --out "$OUT" "$OPTION" "$value" "$@" 2>/dev/null | grep '"event":"done"')
+
+        if [ -z "$done_line" ]; then
+            echo "$value,$run,failed,,,"
+        else
+            echo "$done_line" | sed -e 's/.*"files":\([0-9]*\).*"seconds":\([0-9.]*\),"files_per_sec":\([0-9.]*\),"mb_per_sec":\([0-9.]*\).*/'"$value"','"$run"',\1,\2,\3,\4/'
+        fi
+
+        run=$((run + 1))
+    done
+done
+
+rm -rf "$OUT"
@@ -0,0 +1,455 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+
+#include "searchengine.h"
+
+#define MIN_SEARCH_LENGTH   3
+#define SEARCH_BATCH_SIZE   4096
+
+// Characters are reduced to 64 classes before indexing, so that the trigram table is small
+// enough to be a flat array. Collisions only make a candidate list a bit bigger, every
+// candidate is verified against the real name anyway.
+#define TRIGRAM_CLASS_BITS  6
+#define NUM_TRIGRAMS        (1 << (TRIGRAM_CLASS_BITS*3))
+
+static inline uint32_t CharClass(uint8_t ch)
+{
+    if (ch >= 'a' && ch <= 'z')
+        return ch - 'a';
+
+    if (ch >= '0' && ch <= '9')
+        return 26 + (ch - '0');
+
+    switch (ch)
+    {
+        case '_': return 36;
+        case '.': return 37;
+        case '/': case '\\': return 38;
+        case '-': return 39;
+        case ' ': return 40;
+    }
+
+    return 41 + (ch % 23);
+}
+
+static const char *FindSegment(const char *str, size_t len, const std::string &segment)
+{
+    size_t seg_len = segment.length();
+
+    if (seg_len > len)
+        return nullptr;
+
+    const char *last = str + (len - seg_len);
+
+    for (const char *p = str; p <= last; p++)
+    {
+        p = (const char *)memchr(p, segment[0], (size_t)(last - p) + 1);
+        if (!p)
+            return nullptr;
+
+        if (memcmp(p+1, segment.data()+1, seg_len-1) == 0)
+            return p;
+    }
+
+    return nullptr;
+}
+
+void SearchEngine::Fold(std::string &str)
+{
+    for (char &ch : str)
+    {
+        if (ch >= 'A' && ch <= 'Z')
+            ch += ('a' - 'A');
+    }
+}
+
+void SearchEngine::GetTrigrams(const char *str, size_t len, std::vector<uint32_t> &trigrams)
+{
+    trigrams.clear();
+
+    for (size_t i = 2; i < len; i++)
+    {
+        uint32_t trigram = (CharClass((uint8_t)str[i-2]) << (TRIGRAM_CLASS_BITS*2)) |
+                           (CharClass((uint8_t)str[i-1]) << TRIGRAM_CLASS_BITS) |
+                            CharClass((uint8_t)str[i]);
+
+        trigrams.push_back(trigram);
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+void SearchEngine::BuildTrigrams()
+{
+    size_t num_files = file_ids.size();
+    std::vector<uint32_t> trigrams;
+
+    // Two passes: count the postings of every trigram, then fill them.
+    // Entries are visited in order, so every posting list ends up sorted.
+    trigram_offset.assign(NUM_TRIGRAMS+1, 0);
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        GetTrigrams(names.data() + names_offset[i], names_offset[i+1] - names_offset[i], trigrams);
+
+        for (uint32_t trigram : trigrams)
+            trigram_offset[trigram+1]++;
+    }
+
+    for (size_t i = 0; i < NUM_TRIGRAMS; i++)
+        trigram_offset[i+1] += trigram_offset[i];
+
+    std::vector<uint32_t> cursor(trigram_offset.begin(), trigram_offset.end()-1);
+    trigram_postings.resize(trigram_offset[NUM_TRIGRAMS]);
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        GetTrigrams(names.data() + names_offset[i], names_offset[i+1] - names_offset[i], trigrams);
+
+        for (uint32_t trigram : trigrams)
+            trigram_postings[cursor[trigram]++] = (uint32_t)i;
+    }
+}
+
+void SearchEngine::BuildNameRanks()
+{
+    size_t num_files = file_ids.size();
+    std::vector<uint32_t> order(num_files);
+
+    for (size_t i = 0; i < num_files; i++)
+        order[i] = (uint32_t)i;
+
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        uint32_t len_a = names_offset[a+1] - names_offset[a];
+        uint32_t len_b = names_offset[b+1] - names_offset[b];
+        int cmp = memcmp(names.data() + names_offset[a], names.data() + names_offset[b], std::min(len_a, len_b));
+
+        if (cmp != 0)
+            return (cmp < 0);
+
+        if (len_a != len_b)
+            return (len_a < len_b);
+
+        return (a < b);
+    });
+
+    name_ranks.resize(num_files);
+    for (size_t i = 0; i < num_files; i++)
+        name_ranks[order[i]] = (uint32_t)i;
+}
+
+void SearchEngine::BuildTypeRanks()
+{
+    size_t num_files = file_ids.size();
+    std::vector<std::string> types(num_files);
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        const char *name = names.data() + names_offset[i];
+        const char *end = names.data() + names_offset[i+1];
+        const char *dot = end;
+
+        while (dot > name && dot[-1] != '.')
+            dot--;
+
+        // Upper case, as the column shows it, so that the order is the same
+        types[i].assign(dot, end);
+        for (char &ch : types[i])
+        {
+            if (ch >= 'a' && ch <= 'z')
+                ch -= ('a' - 'A');
+        }
+    }
+
+    // There are only a few different types, the rank is the position among them
+    std::vector<std::string> sorted = types;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    type_ranks.resize(num_files);
+    for (size_t i = 0; i < num_files; i++)
+        type_ranks[i] = (uint32_t)(std::lower_bound(sorted.begin(), sorted.end(), types[i]) - sorted.begin());
+}
+
+void SearchEngine::Build(RdbFile *rdb)
+{
+    Clear();
+
+    size_t num_files = rdb->GetNumFiles();
+    std::string name;
+
+    names_offset.reserve(num_files+1);
+    file_ids.reserve(num_files);
+    sorted_ids.reserve(num_files);
+
+    for (size_t i = 0; i < num_files; i++)
+    {
+        rdb->GetFileName(i, name);
+        Fold(name);
+
+        names_offset.push_back((uint32_t)names.size());
+        names.insert(names.end(), name.begin(), name.end());
+        file_ids.push_back(rdb->GetEntry(i).file_id);
+        sorted_ids.push_back(((uint64_t)file_ids.back() << 32) | i);
+    }
+
+    names_offset.push_back((uint32_t)names.size());
+
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    BuildTrigrams();
+    BuildNameRanks();
+    BuildTypeRanks();
+}
+
+void SearchEngine::Clear()
+{
+    names.clear();
+    names_offset.clear();
+    file_ids.clear();
+    trigram_offset.clear();
+    trigram_postings.clear();
+    sorted_ids.clear();
+    name_ranks.clear();
+    type_ranks.clear();
+}
+
+bool SearchEngine::Compile(const QString &text, SearchQuery &query)
+{
+    query = SearchQuery();
+    query.text = text.trimmed();
+
+    if (query.text.isEmpty())
+        return true;
+
+    std::string str = Utils::QStringToStdString(query.text);
+    Fold(str);
+    query.folded = str;
+
+    size_t literal_length = 0;
+    size_t start = 0;
+
+    while (start <= str.length())
+    {
+        size_t end = str.find('*', start);
+        if (end == std::string::npos)
+            end = str.length();
+
+        if (end > start)
+        {
+            query.segments.push_back(str.substr(start, end-start));
+            literal_length += (end-start);
+        }
+
+        start = end+1;
+    }
+
+    // One or two characters would just match most of the archive
+    if (literal_length < MIN_SEARCH_LENGTH)
+        return false;
+
+    if (str.find('*') == std::string::npos)
+    {
+        std::string hex = Utils::BeginsWith(str, "0x", false) ? str.substr(2) : str;
+
+        if (hex.length() > 0 && hex.length() <= 8 && hex.find_first_not_of("0123456789abcdef") == std::string::npos)
+        {
+            uint32_t shift = (uint32_t)(8 - hex.length()) * 4;
+
+            query.hash_query = true;
+            query.hash_prefix = (uint32_t)strtoul(hex.c_str(), nullptr, 16) << shift;
+            query.hash_mask = 0xFFFFFFFF << shift;
+        }
+    }
+
+    return true;
+}
+
+bool SearchEngine::MatchesName(const SearchQuery &query, size_t idx) const
+{
+    if (query.segments.size() == 0)
+        return false;
+
+    const char *name = names.data() + names_offset[idx];
+    size_t len = names_offset[idx+1] - names_offset[idx];
+    size_t pos = 0;
+
+    for (const std::string &segment : query.segments)
+    {
+        const char *found = FindSegment(name+pos, len-pos, segment);
+        if (!found)
+            return false;
+
+        pos = (size_t)(found - name) + segment.length();
+    }
+
+    return true;
+}
+
+bool SearchEngine::Matches(const SearchQuery &query, size_t idx) const
+{
+    if (query.hash_query && (file_ids[idx] & query.hash_mask) == query.hash_prefix)
+        return true;
+
+    return MatchesName(query, idx);
+}
+
+bool SearchEngine::GetCandidates(const SearchQuery &query, std::vector<uint32_t> &candidates) const
+{
+    std::vector<uint32_t> trigrams, segment_trigrams;
+
+    for (const std::string &segment : query.segments)
+    {
+        GetTrigrams(segment.data(), segment.length(), segment_trigrams);
+        trigrams.insert(trigrams.end(), segment_trigrams.begin(), segment_trigrams.end());
+    }
+
+    if (trigrams.size() == 0 || trigram_offset.size() == 0)
+        return false;
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+
+    // Intersect starting by the rarest trigram, so that the working set is as small as possible
+    std::sort(trigrams.begin(), trigrams.end(), [this](uint32_t a, uint32_t b)
+    {
+        return (trigram_offset[a+1] - trigram_offset[a]) < (trigram_offset[b+1] - trigram_offset[b]);
+    });
+
+    const uint32_t *first = trigram_postings.data();
+    std::vector<uint32_t> temp;
+
+    candidates.assign(first + trigram_offset[trigrams[0]], first + trigram_offset[trigrams[0]+1]);
+
+    for (size_t i = 1; i < trigrams.size() && candidates.size() > 0; i++)
+    {
+        temp.clear();
+        std::set_intersection(candidates.begin(), candidates.end(),
+                              first + trigram_offset[trigrams[i]], first + trigram_offset[trigrams[i]+1],
+                              std::back_inserter(temp));
+        candidates.swap(temp);
+    }
+
+    return true;
+}
+
+void SearchEngine::FindHashPrefix(const SearchQuery &query, std::vector<size_t> &results) const
+{
+    uint64_t low = (uint64_t)query.hash_prefix << 32;
+    uint64_t high = ((uint64_t)(query.hash_prefix | ~query.hash_mask) << 32) | 0xFFFFFFFF;
+
+    auto it = std::lower_bound(sorted_ids.begin(), sorted_ids.end(), low);
+
+    for (; it != sorted_ids.end() && *it <= high; ++it)
+        results.push_back((size_t)(*it & 0xFFFFFFFF));
+}
+
+void SearchEngine::Run(const SearchQuery &query, std::vector<size_t> &results) const
+{
+    results.clear();
+
+    Run(query, nullptr, [&results](std::vector<size_t> &batch)
+    {
+        results.insert(results.end(), batch.begin(), batch.end());
+        return true;
+    });
+
+    std::sort(results.begin(), results.end());
+}
+
+bool SearchEngine::Run(const SearchQuery &query, const std::vector<size_t> *previous, const BatchCallback &on_batch) const
+{
+    std::vector<size_t> batch;
+    std::vector<uint32_t> candidates;
+
+    batch.reserve(SEARCH_BATCH_SIZE);
+
+    auto flush = [&batch, &on_batch]()
+    {
+        bool ret = on_batch(batch);
+        batch.clear();
+        return ret;
+    };
+
+    if (previous)
+    {
+        for (size_t i = 0; i < previous->size(); i++)
+        {
+            if (Matches(query, (*previous)[i]))
+                batch.push_back((*previous)[i]);
+
+            if (((i+1) % SEARCH_BATCH_SIZE) == 0 && !flush())
+                return false;
+        }
+
+        return flush();
+    }
+
+    if (GetCandidates(query, candidates))
+    {
+        for (size_t i = 0; i < candidates.size(); i++)
+        {
+            if (MatchesName(query, candidates[i]))
+                batch.push_back(candidates[i]);
+
+            if (((i+1) % SEARCH_BATCH_SIZE) == 0 && !flush())
+                return false;
+        }
+    }
+    else if (query.segments.size() > 0)
+    {
+        for (size_t i = 0; i < file_ids.size(); i++)
+        {
+            if (MatchesName(query, i))
+                batch.push_back(i);
+
+            if (((i+1) % SEARCH_BATCH_SIZE) == 0 && !flush())
+                return false;
+        }
+    }
+
+    if (query.hash_query)
+    {
+        std::vector<size_t> hashes;
+
+        FindHashPrefix(query, hashes);
+
+        // The ones that also match by name were already reported
+        for (size_t idx : hashes)
+        {
+            if (!MatchesName(query, idx))
+                batch.push_back(idx);
+        }
+    }
+
+    return flush();
+}
+
+void SearchWork::run()
+{
+    QVector<quint64> entries;
+
+    bool completed = engine->Run(query, previous.get(), [this, &entries](std::vector<size_t> &batch)
+    {
+        if (current_generation->loadAcquire() != generation)
+            return false;
+
+        if (batch.size() > 0)
+        {
+            entries.resize((int)batch.size());
+
+            for (size_t i = 0; i < batch.size(); i++)
+                entries[(int)i] = batch[i];
+
+            emit resultsReady(generation, entries, false);
+        }
+
+        return true;
+    });
+
+    if (completed)
+        emit resultsReady(generation, QVector<quint64>(), true);
+}
@@ -0,0 +1,120 @@
+#ifndef SEARCHENGINE_H
+#define SEARCHENGINE_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QAtomicInt>
+#include <QVector>
+#include <QString>
+#include <functional>
+#include <memory>
+
+#include "DOA6/RdbFile.h"
+
+// A compiled search. The text is split by the wildcards into literal segments that must appear
+// in the name in that order (a query without wildcards is a plain "contains").
+// If the text is also a valid hex number, the entries whose hash starts by it match too.
+struct SearchQuery
+{
+    QString text;
+    std::string folded;
+    std::vector<std::string> segments; // Case folded
+
+    bool hash_query = false;
+    uint32_t hash_prefix = 0;
+    uint32_t hash_mask = 0;
+
+    inline bool IsEmpty() const { return (segments.size() == 0 && !hash_query); }
+
+    // True if every entry matching this query also matches the other one, which is the case
+    // when this one was made by typing more characters at the end of the other.
+    inline bool Refines(const SearchQuery &other) const { return (!other.IsEmpty() && Utils::BeginsWith(folded, other.folded, true)); }
+};
+
+// Case folded copy of all the file names of a RdbFile, in a single buffer, plus the hashes,
+// so that a search doesn't have to build any string per entry.
+// Names are also indexed by trigram, so that a query with a segment of 3 or more characters
+// only has to check the entries that contain all of its trigrams, and hashes are kept sorted
+// so that a hash prefix is a binary search.
+class SearchEngine
+{
+public:
+
+    void Build(RdbFile *rdb);
+    void Clear();
+
+    inline size_t GetNumFiles() const { return file_ids.size(); }
+
+    // Position of every entry in the list sorted by (case folded) name, so that sorting the
+    // files list by name doesn't need the names
+    inline const std::vector<uint32_t> &GetNameRanks() const { return name_ranks; }
+    // Same for the type column (the extension, case insensitive)
+    inline const std::vector<uint32_t> &GetTypeRanks() const { return type_ranks; }
+
+    typedef std::function<bool(std::vector<size_t> &)> BatchCallback;
+
+    static bool Compile(const QString &text, SearchQuery &query);
+    void Run(const SearchQuery &query, std::vector<size_t> &results) const;
+
+    // Reports the results in batches. A batch can be empty, it is also the chance to abort the
+    // search by returning false. If previous is not null, only those entries are checked.
+    bool Run(const SearchQuery &query, const std::vector<size_t> *previous, const BatchCallback &on_batch) const;
+
+    bool Matches(const SearchQuery &query, size_t idx) const;
+
+private:
+
+    std::vector<char> names;
+    std::vector<uint32_t> names_offset; // num_files+1 elements
+    std::vector<uint32_t> file_ids;
+
+    // Trigram -> entries, as one array of postings plus an offset per trigram.
+    std::vector<uint32_t> trigram_offset; // NUM_TRIGRAMS+1 elements
+    std::vector<uint32_t> trigram_postings;
+
+    // file_id << 32 | entry index, sorted
+    std::vector<uint64_t> sorted_ids;
+
+    std::vector<uint32_t> name_ranks;
+    std::vector<uint32_t> type_ranks;
+
+    bool MatchesName(const SearchQuery &query, size_t idx) const;
+
+    static void Fold(std::string &str);
+    static void GetTrigrams(const char *str, size_t len, std::vector<uint32_t> &trigrams);
+
+    void BuildTrigrams();
+    void BuildNameRanks();
+    void BuildTypeRanks();
+    bool GetCandidates(const SearchQuery &query, std::vector<uint32_t> &candidates) const;
+    void FindHashPrefix(const SearchQuery &query, std::vector<size_t> &results) const;
+};
+
+// Runs a search in a worker thread. It gives up as soon as *current_generation no longer
+// is its own generation, which happens when a newer search is started.
+class SearchWork : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+public:
+
+    SearchWork(const SearchEngine *engine, const SearchQuery &query, std::shared_ptr<const std::vector<size_t>> previous, int generation, const QAtomicInt *current_generation) :
+        QRunnable(), engine(engine), query(query), previous(previous), generation(generation), current_generation(current_generation) { }
+
+    void run();
+
+signals:
+
+    void resultsReady(int generation, const QVector<quint64> &entries, bool last);
+
+private:
+
+    const SearchEngine *engine;
+    SearchQuery query;
+    std::shared_ptr<const std::vector<size_t>> previous;
+
+    int generation;
+    const QAtomicInt *current_generation;
+};
+
+#endif // SEARCHENGINE_H
@@ -21,7 +21,7 @@
 #include <QtWidgets/QMenuBar>
 #include <QtWidgets/QStatusBar>
 #include <QtWidgets/QToolBar>
-#include <QtWidgets/QTreeWidget>
+#include <QtWidgets/QTreeView>
 #include <QtWidgets/QWidget>
 
 QT_BEGIN_NAMESPACE
@@ -59,13 +59,16 @@ public:
     QAction *actionFind_dead_files_1_20;
     QAction *actionFind_dead_files_1_21;
     QAction *actionFind_dead_files_1_22;
+    QAction *actionOrder_largest_first;
+    QAction *actionOrder_by_package;
     QWidget *centralWidget;
     QHBoxLayout *horizontalLayout_2;
-    QTreeWidget *filesList;
+    QTreeView *filesList;
     QFrame *previewFrame;
     QComboBox *previewComboBox;
     QMenuBar *menuBar;
     QMenu *menuFile;
+    QMenu *menuExtraction_order;
     QMenu *menuAbout;
     QMenu *menuTools;
     QToolBar *mainToolBar;
@@ -136,6 +139,12 @@ public:
         actionFind_dead_files_1_21->setObjectName(QString::fromUtf8("actionFind_dead_files_1_21"));
         actionFind_dead_files_1_22 = new QAction(MainWindow);
         actionFind_dead_files_1_22->setObjectName(QString::fromUtf8("actionFind_dead_files_1_22"));
+        actionOrder_largest_first = new QAction(MainWindow);
+        actionOrder_largest_first->setObjectName(QString::fromUtf8("actionOrder_largest_first"));
+        actionOrder_largest_first->setCheckable(true);
+        actionOrder_by_package = new QAction(MainWindow);
+        actionOrder_by_package->setObjectName(QString::fromUtf8("actionOrder_by_package"));
+        actionOrder_by_package->setCheckable(true);
         centralWidget = new QWidget(MainWindow);
         centralWidget->setObjectName(QString::fromUtf8("centralWidget"));
         horizontalLayout_2 = new QHBoxLayout(centralWidget);
@@ -143,10 +152,11 @@ public:
         horizontalLayout_2->setContentsMargins(11, 11, 11, 11);
         horizontalLayout_2->setObjectName(QString::fromUtf8("horizontalLayout_2"));
         horizontalLayout_2->setContentsMargins(3, 0, 3, 0);
-        filesList = new QTreeWidget(centralWidget);
+        filesList = new QTreeView(centralWidget);
         filesList->setObjectName(QString::fromUtf8("filesList"));
         filesList->setContextMenuPolicy(Qt::ActionsContextMenu);
         filesList->setRootIsDecorated(false);
+        filesList->setUniformRowHeights(true);
 
         horizontalLayout_2->addWidget(filesList);
 
@@ -169,6 +179,8 @@ public:
         menuBar->setGeometry(QRect(0, 0, 1030, 21));
         menuFile = new QMenu(menuBar);
         menuFile->setObjectName(QString::fromUtf8("menuFile"));
+        menuExtraction_order = new QMenu(menuFile);
+        menuExtraction_order->setObjectName(QString::fromUtf8("menuExtraction_order"));
         menuAbout = new QMenu(menuBar);
         menuAbout->setObjectName(QString::fromUtf8("menuAbout"));
         menuTools = new QMenu(menuBar);
@@ -189,7 +201,10 @@ public:
         menuFile->addSeparator();
         menuFile->addAction(actionExtract_selection);
         menuFile->addAction(actionExtract_all);
+        menuFile->addAction(menuExtraction_order->menuAction());
         menuFile->addAction(actionExit);
+        menuExtraction_order->addAction(actionOrder_largest_first);
+        menuExtraction_order->addAction(actionOrder_by_package);
         menuAbout->addAction(actionAbout);
         menuTools->addAction(actionFind_dead_files_1_01);
         menuTools->addAction(actionFind_dead_files_1_02);
@@ -256,13 +271,10 @@ public:
         actionFind_dead_files_1_20->setText(QCoreApplication::translate("MainWindow", "Find dead files (1.20)", nullptr));
         actionFind_dead_files_1_21->setText(QCoreApplication::translate("MainWindow", "Find dead files (1.21)", nullptr));
         actionFind_dead_files_1_22->setText(QCoreApplication::translate("MainWindow", "Find dead files (1.22)", nullptr));
-        QTreeWidgetItem *___qtreewidgetitem = filesList->headerItem();
-        ___qtreewidgetitem->setText(4, QCoreApplication::translate("MainWindow", "Container / Version", nullptr));
-        ___qtreewidgetitem->setText(3, QCoreApplication::translate("MainWindow", "Type", nullptr));
-        ___qtreewidgetitem->setText(2, QCoreApplication::translate("MainWindow", "Size", nullptr));
-        ___qtreewidgetitem->setText(1, QCoreApplication::translate("MainWindow", "Hash", nullptr));
-        ___qtreewidgetitem->setText(0, QCoreApplication::translate("MainWindow", "Name", nullptr));
+        actionOrder_largest_first->setText(QCoreApplication::translate("MainWindow", "Largest files first", nullptr));
+        actionOrder_by_package->setText(QCoreApplication::translate("MainWindow", "By package (hard disks)", nullptr));
         menuFile->setTitle(QCoreApplication::translate("MainWindow", "File", nullptr));
+        menuExtraction_order->setTitle(QCoreApplication::translate("MainWindow", "Extraction order", nullptr));
         menuAbout->setTitle(QCoreApplication::translate("MainWindow", "Help", nullptr));
         menuTools->setTitle(QCoreApplication::translate("MainWindow", "Tools", nullptr));
     } // retranslateUi
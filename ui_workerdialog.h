@@ -27,6 +27,7 @@ public:
     QPushButton *cancelButton;
     QLabel *label_2;
     QComboBox *priorityComboBox;
+    QLabel *speedLabel;
 
     void setupUi(QDialog *WorkerDialog)
     {
@@ -51,6 +52,9 @@ public:
         priorityComboBox->addItem(QString());
         priorityComboBox->setObjectName(QString::fromUtf8("priorityComboBox"));
         priorityComboBox->setGeometry(QRect(340, 30, 111, 22));
+        speedLabel = new QLabel(WorkerDialog);
+        speedLabel->setObjectName(QString::fromUtf8("speedLabel"));
+        speedLabel->setGeometry(QRect(16, 98, 300, 16));
 
         retranslateUi(WorkerDialog);
 
@@ -65,6 +69,7 @@ public:
         label_2->setText(QCoreApplication::translate("WorkerDialog", "IO Priority:", nullptr));
         priorityComboBox->setItemText(0, QCoreApplication::translate("WorkerDialog", "Normal", nullptr));
         priorityComboBox->setItemText(1, QCoreApplication::translate("WorkerDialog", "Background", nullptr));
+        speedLabel->setText(QString());
 
     } // retranslateUi
 
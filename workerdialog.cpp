@@ -11,6 +11,11 @@ WorkerDialog::WorkerDialog(QWidget *parent) :
     setWindowFlags(windowFlags() & ~Qt::WindowContextHelpButtonHint);
 
     window = dynamic_cast<MainWindow *>(parent);
+
+    engine = new ExportEngine(&window->rdb_pool, this);
+    connect(engine, SIGNAL(progress(int,int)), this, SLOT(onProgress(int,int)));
+    connect(engine, SIGNAL(finished()), this, SLOT(onFinished()));
+    connect(engine, SIGNAL(error()), this, SLOT(onError()));
 }
 
 WorkerDialog::~WorkerDialog()
@@ -24,17 +29,10 @@ int WorkerDialog::exec()
     return QDialog::exec();
 }
 
-void WorkerDialog::setExport(RdbFile *rdb, const std::vector<uint32_t> &hashes, const std::string &dir)
+void WorkerDialog::setExport(RdbFile *rdb, const std::vector<size_t> &entries, const std::string &dir)
 {
     this->rdb = rdb;
-    this->max_jobs = (int)hashes.size();
-    files_idx.clear();
-    files_idx.resize(hashes.size());
-
-    for (size_t i = 0; i < hashes.size(); i++)
-    {
-        files_idx[i] = rdb->FindFileByID(hashes[i]);
-    }
+    files_idx = entries;
 
     out_dir = dir;
 
@@ -46,7 +44,6 @@ void WorkerDialog::setExport(RdbFile *rdb, const std::vector<uint32_t> &hashes,
 void WorkerDialog::setExportAll(RdbFile *rdb, const std::string &dir)
 {
     this->rdb = rdb;
-    this->max_jobs = (int)rdb->GetNumFiles();
     files_idx.clear();
     files_idx.resize(rdb->GetNumFiles());
 
@@ -62,89 +59,68 @@ void WorkerDialog::setExportAll(RdbFile *rdb, const std::string &dir)
 
 void WorkerDialog::DoExport()
 {
-    QThreadPool *pool = QThreadPool::globalInstance();
-    QVector<ExportWork *> works;
-
-    works.resize((int)files_idx.size());
-
-    priority = ui->priorityComboBox->currentIndex();
+    engine->SetPriority(ui->priorityComboBox->currentIndex());
 
-    for (int i = 0; i < (int)files_idx.size(); i++)
-    {
-        std::string file;
+    timer.start();
+    engine->Start(rdb, files_idx, out_dir);
+}
 
-        rdb->GetFileName(files_idx[i], file);
-        file = Utils::MakePathString(out_dir, file);
+void WorkerDialog::onProgress(int jobs_finished, int max_jobs)
+{
+    Q_UNUSED(max_jobs);
+    ui->progressBar->setValue(jobs_finished);
+    UpdateSpeed();
+}
 
-        works[i] = new ExportWork(window, files_idx[i], file, &priority);
-        connect(works[i], SIGNAL(workFinished()), this, SLOT(onWorkFinished()));
-        connect(this, SIGNAL(cancelSignal()), works[i], SLOT(onCancel()));
-        connect(works[i], SIGNAL(errorSignal()), this, SLOT(onError()));
-    }
+void WorkerDialog::onFinished()
+{
+    UpdateSpeed();
+    done(1);
+}
 
-    jobs_finished = 0;
+void WorkerDialog::UpdateSpeed()
+{
+    double seconds = (double)timer.nsecsElapsed() / 1000000000.0;
 
-    /*pool->setMaxThreadCount(QThread::idealThreadCount());
+    if (seconds <= 0.0)
+        return;
 
-    if (pool->maxThreadCount() > 16)
-        pool->setMaxThreadCount(16);*/
+    uint64_t bytes = engine->GetBytesFinished();
+    double files_per_sec = (double)engine->GetNumFinished() / seconds;
 
-    pool->setMaxThreadCount(1); // Currently RdbFile::ExtractFile is not multithread safe.
+    speed = (double)bytes / (1024.0*1024.0) / seconds;
 
-    //pool->setMaxThreadCount(1); // For slower testing
+    QString text = QString("%1 MB/s, %2 files/s").arg(speed, 0, 'f', 2).arg(files_per_sec, 0, 'f', 0);
 
-    for (int i = 0; i < works.size(); i++)
+    // By bytes, the time of a file is mostly proportional to its size
+    if (bytes > 0 && bytes < engine->GetTotalBytes())
     {
-        pool->start(works[i]);
+        qint64 eta = (qint64)((double)(engine->GetTotalBytes() - bytes) * seconds / (double)bytes);
+        text += QString(", ETA %1:%2").arg(eta / 60).arg(eta % 60, 2, 10, QChar('0'));
     }
-}
-
-void WorkerDialog::onWorkFinished()
-{
-    QMutexLocker locker(&mutex);
-
-    jobs_finished++;
-    ui->progressBar->setValue(jobs_finished);
 
-    if (jobs_finished == max_jobs)
-    {
-        QThreadPool::globalInstance()->waitForDone();
-        done(1);
-    }
+    ui->speedLabel->setText(text);
 }
 
 void WorkerDialog::reject()
 {
-    QMutexLocker locker(&mutex);
-
-    if (jobs_finished != max_jobs)
+    if (!engine->IsDone())
     {
         ui->label->setText("Cancelling...");
 
-        QThreadPool::globalInstance()->clear();
-        emit cancelSignal();
-
-        QThreadPool::globalInstance()->waitForDone();
+        engine->Cancel();
         done(0);
     }
 }
 
 void WorkerDialog::onError()
 {
-    QMutexLocker locker(&mutex);
-
     ui->label->setText("There was an error. Cancelling all jobs...");
-
-    QThreadPool::globalInstance()->clear();
-    emit cancelSignal();
-
-    QThreadPool::globalInstance()->waitForDone();
     done(-1);
 }
 
 void WorkerDialog::onSetWorkSize(int size)
 {
-    max_jobs = size;
     ui->progressBar->setMaximum(size);
 }
 
@@ -155,38 +131,5 @@ void WorkerDialog::on_cancelButton_clicked()
 
 void WorkerDialog::on_priorityComboBox_activated(int index)
 {
-    priority = index;
-}
-
-void ExportWork::run()
-{
-    if (*current_priority == 1)
-    {
-        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
-    }
-    else
-    {
-        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
-    }
-
-    if (cancel)
-        return;
-
-    bool success = window->rdb->ExtractFile(idx, file, true, true);
-    if (!success && !cancel)
-    {
-        emit errorSignal();
-        return;
-    }
-
-
-    if (cancel)
-        return;
-
-    emit workFinished();
-}
-
-void ExportWork::onCancel()
-{
-    cancel = true;
+    engine->SetPriority(index);
 }
@@ -2,49 +2,21 @@
 #define WORKERDIALOG_H
 
 #include <QDialog>
-#include <QThreadPool>
-#include <QMutexLocker>
+#include <QElapsedTimer>
 #include "mainwindow.h"
+#include "exportengine.h"
 
 namespace Ui {
 class WorkerDialog;
 }
 
-class ExportWork : public QObject, public QRunnable
-{
-    Q_OBJECT
-
-public:
-
-    ExportWork(MainWindow *window, size_t idx, const std::string &file, int *priority) : QRunnable(), window(window), idx(idx), file(file), current_priority(priority){ }
-
-    void run();
-
-public slots:
-
-    void onCancel();
-
-signals:
-
-    void workFinished();
-    void errorSignal();
-
-private:
-
-    MainWindow *window;
-    size_t idx;
-    std::string file;
-
-    bool cancel = false;
-    int *current_priority;
-};
-
 class WorkerDialog : public QDialog
 {
     Q_OBJECT
 
 public slots:
-    void onWorkFinished();
+    void onProgress(int jobs_finished, int max_jobs);
+    void onFinished();
     void reject() override;
     void onError();
     void onSetWorkSize(int size);
@@ -55,12 +27,13 @@ public:
 
     int exec() override;
 
-    void setExport(RdbFile *rdb, const std::vector<uint32_t> &hashes, const std::string &dir);
+    void setExport(RdbFile *rdb, const std::vector<size_t> &entries, const std::string &dir);
     void setExportAll(RdbFile *rdb, const std::string &dir);
+    // EXPORT_ORDER_*
+    inline void setOrder(int order) { engine->SetOrder(order); }
 
-signals:
-
-    void cancelSignal();
+    // MB/s of the last extraction
+    inline double GetSpeed() const { return speed; }
 
 private slots:
     void on_cancelButton_clicked();
@@ -75,10 +48,11 @@ private:
     std::vector<size_t> files_idx;
     std::string out_dir;
 
-    QMutex mutex;
-    int jobs_finished = 0;
-    int max_jobs;
-    int priority=0;
+    ExportEngine *engine;
+    QElapsedTimer timer;
+    double speed = 0.0;
+
+    void UpdateSpeed();
 
     void DoExport();
 };